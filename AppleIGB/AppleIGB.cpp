@@ -1,10 +1,12 @@
 #include <IOKit/pci/IOPCIDevice.h>
 #include <IOKit/network/IOEthernetController.h>
 #include <IOKit/network/IOEthernetInterface.h>
-#include <IOKit/network/IOGatedOutputQueue.h>
+#include <IOKit/network/IOOutputQueue.h>
 #include <IOKit/network/IOMbufMemoryCursor.h>
 #include <IOKit/network/IOPacketQueue.h>
 #include <IOKit/IOTimerEventSource.h>
+#include <IOKit/IOCommandGate.h>
+#include <IOKit/IOUserClient.h>
 #include <IOKit/IODeviceMemory.h>
 #include <IOKit/IOFilterInterruptEventSource.h>
 #include <IOKit/IOBufferMemoryDescriptor.h>
@@ -12,6 +14,7 @@
 
 extern "C" {
 #include <sys/kpi_mbuf.h>
+#include <kern/clock.h>
 #include <net/ethernet.h>
 }
 
@@ -88,6 +91,22 @@ static void kfree(void* p, size_t size)
 	IOFree(p, size);
 }
 
+static void* kzalloc_aligned(size_t size, size_t align)
+{
+	void* p = IOMallocAligned(size, align);
+	if(p){
+		bzero(p, size);
+	} else {
+		pr_err("kzalloc_aligned: failed size = %d\n", (int)size );
+	}
+	return p;
+}
+
+static void kfree_aligned(void* p, size_t size)
+{
+	IOFreeAligned(p, size);
+}
+
 
 static void* vzalloc(size_t size)
 {
@@ -163,7 +182,11 @@ static void netif_stop_queue(IOEthernetController* netdev)
 static mbuf_t netdev_alloc_skb_ip_align(IOEthernetController* netdev, u16 rx_buffer_len)
 {
     mbuf_t skb = netdev->allocatePacket(rx_buffer_len);
-    mbuf_pkthdr_setlen(skb, 0);
+    /* empty, the receive path appends at mbuf_len */
+    if (skb) {
+        mbuf_setlen(skb, 0);
+        mbuf_pkthdr_setlen(skb, 0);
+    }
 	return skb;
 }
 
@@ -197,6 +220,73 @@ static int time_after(u64 a, u64 b)
 
 #define schedule_work(a)	(*(a))->setTimeoutMS(1)
 
+#ifdef IGB_DEBUG_SLEEP_SITES
+/**
+ * igb_sleep_sites - time spent in msleep/mdelay, per calling function
+ *
+ * Only in builds with IGB_DEBUG_SLEEP_SITES, which routes the kcompat
+ * delay macros through igb_delay_site.  Shared by every port; the shared
+ * code has no adapter at hand when it sleeps.  Slots are claimed once
+ * per site and never released, so a snapshot can walk the table without
+ * a lock.
+ **/
+#define IGB_SLEEP_SITES	32
+static struct igb_sleep_site {
+	void * volatile site;		/* the caller's __func__ */
+	volatile SInt32 calls;
+	volatile SInt64 ns __attribute__((aligned(8)));
+} igb_sleep_sites[IGB_SLEEP_SITES];
+
+void igb_delay_site(const char *site, unsigned int ms, int busy)
+{
+	u64 start = mach_absolute_time(), ns;
+	struct igb_sleep_site *slot = NULL;
+	int i;
+
+	if (busy) {
+		for (i = 0; i < (int)ms; i++)
+			IODelay(1000);
+	} else {
+		IOSleep(ms);
+	}
+	absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+
+	for (i = 0; i < IGB_SLEEP_SITES; i++) {
+		if (igb_sleep_sites[i].site == site ||
+		    OSCompareAndSwapPtr(NULL, (void *)site,
+					&igb_sleep_sites[i].site) ||
+		    igb_sleep_sites[i].site == site) {
+			slot = &igb_sleep_sites[i];
+			break;
+		}
+	}
+	if (!slot)
+		return;
+	OSIncrementAtomic(&slot->calls);
+	OSAddAtomic64(ns, &slot->ns);
+}
+#endif /* IGB_DEBUG_SLEEP_SITES */
+
+static inline void igb_phase_begin(struct igb_adapter *adapter,
+				   enum igb_boot_phase phase)
+{
+	adapter->boot_phase[phase].start = mach_absolute_time();
+}
+
+static void igb_phase_end(struct igb_adapter *adapter,
+			  enum igb_boot_phase phase)
+{
+	struct igb_boot_timer *timer = &adapter->boot_phase[phase];
+	u64 ns;
+
+	if (!timer->start)
+		return;
+	absolutetime_to_nanoseconds(mach_absolute_time() - timer->start, &ns);
+	timer->ns += ns;
+	timer->count++;
+	timer->start = 0;
+}
+
 static int pci_enable_device_mem(IOPCIDevice *dev)
 {
 	if(dev->setMemoryEnable(true))
@@ -241,6 +331,62 @@ static int pci_enable_msi_block(IOPCIDevice *dev )
 	return status;
 }
 
+/* collect the provider's interrupt indices that deliver PCI messages */
+static int pci_msg_vectors(IOPCIDevice *dev, u32 *vectors, int max)
+{
+	int intrIndex = 0, intrType, count = 0;
+
+	while (count < max &&
+		   dev->getInterruptType(intrIndex, &intrType) == kIOReturnSuccess) {
+		if (intrType & kIOInterruptTypePCIMessaged)
+			vectors[count++] = intrIndex;
+		intrIndex++;
+	}
+	return count;
+}
+
+/*
+ * The PCI family programs the MSI-X table itself and publishes one
+ * messaged interrupt index per vector, so "enabling" only means mapping
+ * each requested entry onto such an index. The index is kept in
+ * msix_entry.vector for the interrupt event sources.
+ */
+static int pci_enable_msix(IOPCIDevice *dev, struct msix_entry *entries, int nvec)
+{
+	u32 vectors[MAX_Q_VECTORS + NON_Q_VECTORS];
+	int i, count;
+
+	if (dev->findPCICapability(kIOPCIMSIXCapability) == 0)
+		return -EINVAL;
+	if (nvec > MAX_Q_VECTORS + NON_Q_VECTORS)
+		return MAX_Q_VECTORS + NON_Q_VECTORS;
+
+	count = pci_msg_vectors(dev, vectors, nvec);
+	if (count < nvec)
+		return count ? count : -EINVAL;
+
+	for (i = 0; i < nvec; i++)
+		entries[i].vector = vectors[entries[i].entry];
+	return 0;
+}
+
+static int pci_enable_msi(IOPCIDevice *dev)
+{
+	u32 vector;
+
+	if (dev->findPCICapability(kIOPCIMSICapability) == 0)
+		return -EINVAL;
+	return pci_msg_vectors(dev, &vector, 1) ? 0 : -EINVAL;
+}
+
+/* interrupt index of the single MSI vector, or 0 for the legacy line */
+static int pci_msi_index(IOPCIDevice *dev)
+{
+	u32 vector;
+
+	return pci_msg_vectors(dev, &vector, 1) ? vector : 0;
+}
+
 static int igb_setup_all_tx_resources(struct igb_adapter *);
 static int igb_setup_all_rx_resources(struct igb_adapter *);
 static void igb_free_all_tx_resources(struct igb_adapter *);
@@ -278,6 +424,9 @@ static void igb_update_dca(struct igb_q_vector *);
 static void igb_setup_dca(struct igb_adapter *);
 #endif /* IGB_DCA */
 static int igb_poll(struct igb_q_vector *, int);
+#ifdef __APPLE__
+static const struct igb_itr_ops *igb_itr_controller(u32 itr_ctl);
+#endif
 static bool igb_clean_tx_irq(struct igb_q_vector *);
 static bool igb_clean_rx_irq(struct igb_q_vector *, int);
 static int igb_ioctl(IOEthernetController*, struct ifreq *, int cmd);
@@ -286,20 +435,6 @@ static void igb_reset_task(struct work_struct *);
 #ifdef HAVE_VLAN_RX_REGISTER
 static void igb_vlan_mode(IOEthernetController*, struct vlan_group *);
 #endif
-#ifdef HAVE_INT_NDO_VLAN_RX_ADD_VID
-#ifdef NETIF_F_HW_VLAN_CTAG_RX
-static int igb_vlan_rx_add_vid(struct net_device *,
-                               __always_unused __be16 proto, u16);
-static int igb_vlan_rx_kill_vid(struct net_device *,
-                                __always_unused __be16 proto, u16);
-#else
-static int igb_vlan_rx_add_vid(struct net_device *, u16);
-static int igb_vlan_rx_kill_vid(struct net_device *, u16);
-#endif
-#else
-static void igb_vlan_rx_add_vid(struct net_device *, u16);
-static void igb_vlan_rx_kill_vid(struct net_device *, u16);
-#endif
 static void igb_restore_vlan(struct igb_adapter *);
 static void igb_ping_all_vfs(struct igb_adapter *);
 static void igb_msg_task(struct igb_adapter *);
@@ -399,6 +534,170 @@ static void igb_vfta_set(struct igb_adapter *adapter, u32 vid, bool add)
 	adapter->shadow_vfta[index] = vfta;
 }
 
+#ifdef __APPLE__
+/**
+ * igb_vfta_write_all - program the whole VLAN filter table from the shadow
+ * @adapter: board private structure
+ *
+ * One register write per 32 VLAN IDs instead of one per ID, so the table
+ * can be rebuilt after a reset without walking all 4096 IDs.
+ **/
+static void igb_vfta_write_all(struct igb_adapter *adapter)
+{
+	struct e1000_hw *hw = &adapter->hw;
+	struct e1000_host_mng_dhcp_cookie *mng_cookie = &hw->mng_cookie;
+	u32 i;
+
+	/* keep management pass through working, as igb_vfta_set does */
+	if (mng_cookie->status & E1000_MNG_DHCP_COOKIE_STATUS_VLAN) {
+		u16 vid = mng_cookie->vlan_id;
+
+		adapter->shadow_vfta[(vid >> E1000_VFTA_ENTRY_SHIFT) &
+				     E1000_VFTA_ENTRY_MASK] |=
+			1 << (vid & E1000_VFTA_ENTRY_BIT_SHIFT_MASK);
+	}
+
+	for (i = 0; i < E1000_VLAN_FILTER_TBL_SIZE; i++)
+		e1000_write_vfta(hw, i, adapter->shadow_vfta[i]);
+}
+
+/**
+ * igb_vlan_rx_add_all - accept every VLAN ID
+ * @adapter: board private structure
+ *
+ * Builds the table image for IDs 1..4095 in memory and writes it in one
+ * pass.  Only the PF receives here, so no VLVF pool entries are set up;
+ * the VF paths still program those through igb_vlvf_set.
+ **/
+static void igb_vlan_rx_add_all(struct igb_adapter *adapter)
+{
+	u32 i;
+
+	for (i = 0; i < E1000_VLAN_FILTER_TBL_SIZE; i++)
+		adapter->shadow_vfta[i] = ~0U;
+	/* VID 0 is priority tagging only, leave it out of the filter */
+	adapter->shadow_vfta[0] &= ~1U;
+
+	for (i = 0; i < BITS_TO_LONGS(VLAN_N_VID); i++)
+		adapter->active_vlans[i] = ~0UL;
+	clear_bit(0, adapter->active_vlans);
+
+	igb_vfta_write_all(adapter);
+}
+#endif /* __APPLE__ */
+
+#ifdef __APPLE__
+/**
+ * igb_read_nvm_shadow - nvm.ops.read served from the probe time shadow
+ * @hw: pointer to the HW structure
+ * @offset: first word
+ * @words: number of words
+ * @data: words read
+ *
+ * Checksum validation, the MAC address, PBA, firmware version and LED
+ * defaults all sit in the first words of the NVM; only reads past the
+ * shadow still go through EERD.
+ **/
+static s32 igb_read_nvm_shadow(struct e1000_hw *hw, u16 offset, u16 words,
+			       u16 *data)
+{
+	struct igb_adapter *adapter = (igb_adapter *)hw->back;
+
+	if (adapter->nvm_shadow_valid &&
+	    (u32)offset + words <= adapter->nvm_shadow_words) {
+		memcpy(data, &adapter->nvm_shadow[offset], words * sizeof(u16));
+		adapter->nvm_shadow_hits++;
+		return E1000_SUCCESS;
+	}
+	adapter->nvm_hw_words += words;
+	return adapter->nvm_read(hw, offset, words, data);
+}
+
+/* any write drops the shadow; later reads go to the NVM until the next probe */
+static s32 igb_write_nvm_shadow(struct e1000_hw *hw, u16 offset, u16 words,
+				u16 *data)
+{
+	struct igb_adapter *adapter = (igb_adapter *)hw->back;
+
+	adapter->nvm_shadow_valid = false;
+	return adapter->nvm_write(hw, offset, words, data);
+}
+
+/* the i210 checksum update writes through EEWR without nvm.ops.write */
+static s32 igb_update_nvm_shadow(struct e1000_hw *hw)
+{
+	struct igb_adapter *adapter = (igb_adapter *)hw->back;
+
+	adapter->nvm_shadow_valid = false;
+	return adapter->nvm_update(hw);
+}
+
+/**
+ * igb_nvm_shadow_hook - route nvm.ops through the shadow
+ * @adapter: board private structure
+ *
+ * Again after every e1000_setup_init_funcs, which puts back the uncached
+ * ops.  The ops table lives in this port's e1000_hw, so the other ports
+ * and the shared code's own callers are untouched.
+ **/
+static void igb_nvm_shadow_hook(struct igb_adapter *adapter)
+{
+	struct e1000_nvm_operations *ops = &adapter->hw.nvm.ops;
+
+	if (ops->read == igb_read_nvm_shadow)
+		return;
+	adapter->nvm_read = ops->read;
+	adapter->nvm_write = ops->write;
+	adapter->nvm_update = ops->update;
+	ops->read = igb_read_nvm_shadow;
+	if (ops->write)
+		ops->write = igb_write_nvm_shadow;
+	if (ops->update)
+		ops->update = igb_update_nvm_shadow;
+}
+
+/**
+ * igb_nvm_shadow_fill - read the start of the NVM in one request
+ * @adapter: board private structure
+ *
+ * The first 0x80 words, or the checksummed sections of all four LAN
+ * functions on 82580 and later.  EERD still moves one word per poll, but
+ * each word is read once instead of once per consumer and per reset.
+ *
+ * The hook goes in here rather than in igb_sw_init: nothing reads the
+ * NVM before this point of probe, and the read needs the e1000_reset_hw
+ * just before it.
+ **/
+static void igb_nvm_shadow_fill(struct igb_adapter *adapter)
+{
+	struct e1000_hw *hw = &adapter->hw;
+	u16 words = 0x80;
+
+	/* the iNVM of flashless i210/i211 reads a single word per call */
+	if (hw->nvm.type == e1000_nvm_invm)
+		return;
+	igb_nvm_shadow_hook(adapter);
+	if (hw->mac.type >= e1000_82580 && hw->mac.type < e1000_i210)
+		words = NVM_82580_LAN_FUNC_OFFSET(3) + NVM_CHECKSUM_REG + 1;
+	if (hw->nvm.word_size && words > hw->nvm.word_size) {
+		pr_debug("NVM shadow capped at %u of %u words\n",
+			 hw->nvm.word_size, words);
+		words = hw->nvm.word_size;
+	}
+
+	if (!adapter->nvm_shadow) {
+		adapter->nvm_shadow = (u16 *)kzalloc(words * sizeof(u16));
+		if (!adapter->nvm_shadow)
+			return;
+		adapter->nvm_shadow_words = words;
+	}
+	adapter->nvm_hw_words += adapter->nvm_shadow_words;
+	adapter->nvm_shadow_valid =
+		adapter->nvm_read(hw, 0, adapter->nvm_shadow_words,
+				  adapter->nvm_shadow) == E1000_SUCCESS;
+}
+#endif /* __APPLE__ */
+
 #define Q_IDX_82576(i) (((i & 0x1) << 3) + (i >> 1))
 /**
  * igb_cache_ring_register - Descriptor ring to register mapping
@@ -455,6 +754,41 @@ u32 e1000_read_reg(struct e1000_hw *hw, u32 reg)
 	return value;
 }
 
+/**
+ * e1000_mdic_wait - wait for the MDIC transaction just issued
+ * @hw: pointer to the HW structure
+ *
+ * The first look is after one MDIO frame's time, then every
+ * IGB_MDIC_STEP_US up to IGB_MDIC_FAST_US, so an access is seen done
+ * within a few usec of finishing instead of on the next 50 usec poll.
+ * Slower ones go back to the shared code's 50 usec polls and give up
+ * after the same E1000_GEN_POLL_TIMEOUT * 3 polls it allowed.
+ * Returns the last MDIC value read.
+ **/
+u32 e1000_mdic_wait(struct e1000_hw *hw)
+{
+	struct igb_adapter *adapter = (igb_adapter *)hw->back;
+	u32 delay = IGB_MDIC_FIRST_US, waited = 0, mdic, i = 0;
+
+	for (;;) {
+		udelay(delay);
+		waited += delay;
+		mdic = E1000_READ_REG(hw, E1000_MDIC);
+		if (mdic & E1000_MDIC_READY)
+			break;
+		if (waited >= E1000_GEN_POLL_TIMEOUT * 3 * 50) {
+			OSIncrementAtomic((volatile SInt32 *) &adapter->mdic_timeouts);
+			break;
+		}
+		delay = waited < IGB_MDIC_FAST_US ? IGB_MDIC_STEP_US : 50;
+	}
+
+	while (i < IGB_MDIC_BUCKETS - 1 && waited >= (32U << i))
+		i++;
+	OSIncrementAtomic((volatile SInt32 *) &adapter->mdic_wait_hist[i]);
+	return mdic;
+}
+
 static void igb_configure_lli(struct igb_adapter *adapter)
 {
 	struct e1000_hw *hw = &adapter->hw;
@@ -464,6 +798,15 @@ static void igb_configure_lli(struct igb_adapter *adapter)
 	if (!adapter->msix_entries && !(adapter->flags & IGB_FLAG_HAS_MSI))
 		return;
 	
+#ifdef __APPLE__
+	/* filters can be turned off again through setProperties */
+	for (int i = 0; i < 3; i++) {
+		E1000_WRITE_REG(hw, E1000_IMIR(i), 0);
+		E1000_WRITE_REG(hw, E1000_IMIREXT(i), 0);
+	}
+	
+#endif
+	
 	if (adapter->lli_port) {
 		/* use filter 0 for port */
 		port = htons((u16)adapter->lli_port);
@@ -673,7 +1016,18 @@ static void igb_configure_msix(struct igb_adapter *adapter)
 static int igb_request_msix(struct igb_adapter *adapter)
 {
 #ifdef __APPLE__
-	return -1;
+	/* the event sources are owned by AppleIGB, vector 0 is "other" */
+	int i;
+
+	for (i = 0; i < adapter->num_q_vectors; i++) {
+		struct igb_q_vector *q_vector = adapter->q_vector[i];
+
+		q_vector->itr_register = adapter->io_addr +
+			E1000_EITR(i + NON_Q_VECTORS);
+	}
+
+	igb_configure_msix(adapter);
+	return 0;
 #else
 	IOEthernetController* netdev = adapter->netdev;
 	int i, err = 0, vector = 0, free_vector = 0;
@@ -743,11 +1097,11 @@ static void igb_free_q_vector(struct igb_adapter *adapter, int v_idx)
 	/* igb_get_stats64() might access the rings on this vector,
 	 * we must wait a grace period before freeing it.
 	 */
-	kfree(q_vector, q_vector->alloc_size);
-	
-#ifndef IGB_NO_LRO
+#if !defined(IGB_NO_LRO) && !defined(__APPLE__)
 	__skb_queue_purge(&q_vector->lrolist.active);
 #endif
+	/* AppleIGB hands every held flow up before igb_clean_rx_irq returns */
+	kfree_aligned(q_vector, q_vector->alloc_size);
 }
 
 /**
@@ -784,10 +1138,13 @@ static void igb_reset_interrupt_capability(struct igb_adapter *adapter)
 
 	if (adapter->msix_entries) {
 		//pci_disable_msix(adapter->pdev);
-		kfree(adapter->msix_entries,sizeof(struct msix_entry));
+		kfree(adapter->msix_entries,
+			  sizeof(struct msix_entry) * adapter->num_msix_entries);
 		adapter->msix_entries = NULL;
+		adapter->num_msix_entries = 0;
 	} else if (adapter->flags & IGB_FLAG_HAS_MSI) {
 		//pci_disable_msi(adapter->pdev);
+		adapter->flags &= ~IGB_FLAG_HAS_MSI;
 	}
 	while (v_idx--)
 		igb_reset_q_vector(adapter, v_idx);
@@ -1030,8 +1387,8 @@ err_out:
  **/
 static void igb_set_interrupt_capability(struct igb_adapter *adapter, bool msix)
 {
-	//IOPCIDevice *pdev = adapter->pdev;
-	//int err;
+	IOPCIDevice *pdev = adapter->pdev;
+	int err, i;
 	int numvecs;
 
 	if (!msix)
@@ -1043,7 +1400,7 @@ static void igb_set_interrupt_capability(struct igb_adapter *adapter, bool msix)
 	if (adapter->vmdq_pools > 1)
 		adapter->num_rx_queues += adapter->vmdq_pools - 1;
 	
-#ifdef HAVE_TX_MQ
+#if defined(HAVE_TX_MQ) || defined(__APPLE__)
 	if (adapter->vmdq_pools)
 		adapter->num_tx_queues = adapter->vmdq_pools;
 	else
@@ -1068,9 +1425,11 @@ static void igb_set_interrupt_capability(struct igb_adapter *adapter, bool msix)
 			
 			/* add 1 vector for link status interrupts */
 			numvecs++;
-#ifndef __APPLE__
 			adapter->msix_entries = (msix_entry*)kcalloc(numvecs, sizeof(struct msix_entry));
 			if (adapter->msix_entries) {
+#ifdef __APPLE__
+				adapter->num_msix_entries = numvecs;
+#endif
 				for (i = 0; i < numvecs; i++)
 					adapter->msix_entries[i].entry = i;
 
@@ -1080,15 +1439,22 @@ static void igb_set_interrupt_capability(struct igb_adapter *adapter, bool msix)
 					break;
 			}
 			/* MSI-X failed, so fall through and try MSI */
+#ifdef __APPLE__
+			pr_err("Failed to initialize MSI-X interrupts. "
+				   "Falling back to MSI interrupts.\n");
+#else
 			dev_warn(pci_dev_to_dev(pdev), "Failed to initialize MSI-X interrupts. "
 					 "Falling back to MSI interrupts.\n");
 #endif
 			igb_reset_interrupt_capability(adapter);
 		case IGB_INT_MODE_MSI:
-#ifndef __APPLE__
 			if (!pci_enable_msi(pdev))
 				adapter->flags |= IGB_FLAG_HAS_MSI;
 			else
+#ifdef __APPLE__
+				pr_err("Failed to initialize MSI "
+					   "interrupts.  Falling back to legacy interrupts.\n");
+#else
 				dev_warn(pci_dev_to_dev(pdev), "Failed to initialize MSI "
 						 "interrupts.  Falling back to legacy interrupts.\n");
 #endif
@@ -1124,6 +1490,47 @@ static void igb_add_ring(struct igb_ring *ring,
 	head->count++;
 }
 
+#ifdef __APPLE__
+/*
+ * Cache line layout of the rings.  A Tx ring is cleaned on its queue work
+ * loop while outputPacket fills it from the controller work loop, so the
+ * clean side (next_to_clean, tx_syncp, tx_stats) and the submit side
+ * (next_to_use through tx_submit_stats) must each stay on a line of their
+ * own.  The rings sit back to back behind the q_vector, so both structs
+ * are padded to whole lines and allocated aligned.
+ */
+#define IGB_LINE(type, member)	(offsetof(type, member) / IGB_CACHE_BYTES)
+#define IGB_LAST_LINE(type, member) \
+	((offsetof(type, member) + sizeof(((type *)0)->member) - 1) / IGB_CACHE_BYTES)
+
+static_assert(offsetof(struct igb_ring, next_to_clean) % IGB_CACHE_BYTES == 0,
+	      "consumer state does not start a cache line");
+static_assert(offsetof(struct igb_ring, next_to_use) % IGB_CACHE_BYTES == 0,
+	      "producer state does not start a cache line");
+static_assert(IGB_LAST_LINE(struct igb_ring, tx_stats) ==
+	      IGB_LINE(struct igb_ring, next_to_clean),
+	      "Tx clean state spills past one cache line");
+static_assert(IGB_LAST_LINE(struct igb_ring, tx_submit_stats) ==
+	      IGB_LINE(struct igb_ring, next_to_use),
+	      "Tx submit state spills past one cache line");
+static_assert(IGB_LAST_LINE(struct igb_ring, rx_stats) <
+	      IGB_LINE(struct igb_ring, next_to_use),
+	      "Rx clean state shares a line with the Tx producer");
+static_assert(IGB_LAST_LINE(struct igb_ring, reg_idx) <
+	      IGB_LINE(struct igb_ring, next_to_clean),
+	      "read mostly fields share a line with the consumer");
+static_assert(sizeof(struct igb_ring) % IGB_CACHE_BYTES == 0,
+	      "igb_ring is not a whole number of cache lines");
+static_assert(IGB_LAST_LINE(struct igb_q_vector, tx) <
+	      IGB_LINE(struct igb_q_vector, ring),
+	      "q_vector hot fields overlap the first ring");
+static_assert(offsetof(struct igb_q_vector, ring) % IGB_CACHE_BYTES == 0,
+	      "q_vector rings are not cache line aligned");
+
+#undef IGB_LAST_LINE
+#undef IGB_LINE
+#endif
+
 /**
  * igb_alloc_q_vector - Allocate memory for a single interrupt vector
  * @adapter: board private structure to initialize
@@ -1156,7 +1563,8 @@ static int igb_alloc_q_vector(struct igb_adapter *adapter,
 	/* allocate q_vector and rings */
 	q_vector = adapter->q_vector[v_idx];
 	if (!q_vector)
-		q_vector = (igb_q_vector*)kzalloc(size);
+		/* the rings carry cache line aligned members, honour that */
+		q_vector = (igb_q_vector*)kzalloc_aligned(size, IGB_CACHE_BYTES);
 	else
 		memset(q_vector, 0, size);
 	if (!q_vector)
@@ -1164,7 +1572,7 @@ static int igb_alloc_q_vector(struct igb_adapter *adapter,
 #ifdef	__APPLE__
 	q_vector->alloc_size = size;
 #endif
-#ifndef IGB_NO_LRO
+#if !defined(IGB_NO_LRO) && !defined(__APPLE__)
 	/* initialize LRO */
 	__skb_queue_head_init(&q_vector->lrolist.active);
 	
@@ -1187,6 +1595,9 @@ static int igb_alloc_q_vector(struct igb_adapter *adapter,
 	/* initialize ITR configuration */
 	q_vector->itr_register = adapter->io_addr + E1000_EITR(0);
 	q_vector->itr_val = IGB_START_ITR;
+#ifdef __APPLE__
+	q_vector->itr_ops = igb_itr_controller(adapter->itr_ctl);
+#endif
 	
 	/* initialize pointer to rings */
 	ring = q_vector->ring;
@@ -1429,6 +1840,22 @@ static void igb_irq_disable(struct igb_adapter *adapter)
 {
 	struct e1000_hw *hw = &adapter->hw;
 	
+	/*
+	 * we need to be careful when disabling interrupts.  The VFs are also
+	 * mapped into these registers and so clearing the bits can cause
+	 * issues on the VF drivers so we only need to clear what we set
+	 */
+	if (adapter->msix_entries) {
+		u32 regval = E1000_READ_REG(hw, E1000_EIAM);
+		E1000_WRITE_REG(hw, E1000_EIAM, regval
+				& ~adapter->eims_enable_mask);
+		E1000_WRITE_REG(hw, E1000_EIMC, adapter->eims_enable_mask);
+		regval = E1000_READ_REG(hw, E1000_EIAC);
+		E1000_WRITE_REG(hw, E1000_EIAC, regval
+				& ~adapter->eims_enable_mask);
+	}
+	
+	E1000_WRITE_REG(hw, E1000_IAM, 0);
 	E1000_WRITE_REG(hw, E1000_IMC, ~0);
 	E1000_WRITE_FLUSH(hw);
 }
@@ -1441,8 +1868,24 @@ static void igb_irq_enable(struct igb_adapter *adapter)
 {
 	struct e1000_hw *hw = &adapter->hw;
 	
-	E1000_WRITE_REG(hw, E1000_IMS, IMS_ENABLE_MASK | E1000_IMS_DRSTA);
-    E1000_WRITE_REG(hw, E1000_IAM, IMS_ENABLE_MASK | E1000_IMS_DRSTA);
+	if (adapter->msix_entries) {
+		u32 ims = E1000_IMS_LSC | E1000_IMS_DOUTSYNC | E1000_IMS_DRSTA;
+		u32 regval = E1000_READ_REG(hw, E1000_EIAC);
+		E1000_WRITE_REG(hw, E1000_EIAC, regval
+				| adapter->eims_enable_mask);
+		regval = E1000_READ_REG(hw, E1000_EIAM);
+		E1000_WRITE_REG(hw, E1000_EIAM, regval
+				| adapter->eims_enable_mask);
+		E1000_WRITE_REG(hw, E1000_EIMS, adapter->eims_enable_mask);
+		if (adapter->vfs_allocated_count) {
+			E1000_WRITE_REG(hw, E1000_MBVFIMR, 0xFF);
+			ims |= E1000_IMS_VMMB;
+		}
+		E1000_WRITE_REG(hw, E1000_IMS, ims);
+	} else {
+		E1000_WRITE_REG(hw, E1000_IMS, IMS_ENABLE_MASK | E1000_IMS_DRSTA);
+		E1000_WRITE_REG(hw, E1000_IAM, IMS_ENABLE_MASK | E1000_IMS_DRSTA);
+	}
 }
 	
 /**
@@ -1530,12 +1973,14 @@ static void igb_configure(struct igb_adapter *adapter)
  **/
 void igb_power_up_link(struct igb_adapter *adapter)
 {
+	igb_phase_begin(adapter, IGB_PHASE_PHY_UP);
 	e1000_phy_hw_reset(&adapter->hw);
 	
 	if (adapter->hw.phy.media_type == e1000_media_type_copper)
 		e1000_power_up_phy(&adapter->hw);
 	else
 		e1000_power_up_fiber_serdes_link(&adapter->hw);
+	igb_phase_end(adapter, IGB_PHASE_PHY_UP);
 }
 	
 /**
@@ -1784,17 +2229,26 @@ int igb_up(struct igb_adapter *adapter)
 	return 0;
 }
 	
-void igb_down(struct igb_adapter *adapter)
+/**
+ * igb_down_quiesce - stop the MAC, first half of igb_down
+ * @adapter: board private structure
+ *
+ * Masks interrupts and disables receives and transmits.  The caller
+ * lets in-flight DMA finish, 10 ms at least, before igb_down_finish.
+ **/
+static void igb_down_quiesce(struct igb_adapter *adapter)
 {
 	IOEthernetController* netdev = adapter->netdev;
 	struct e1000_hw *hw = &adapter->hw;
 	u32 tctl, rctl;
-	//int i;
 	
 	/* signal that we're down so the interrupt handler does not
 	 * reschedule our watchdog timer
 	 */
 	set_bit(__IGB_DOWN, &adapter->state);
+
+	/* no link change interrupt until the restart rearms it */
+	igb_irq_disable(adapter);
 	
 	/* disable receives in the hardware */
 	rctl = E1000_READ_REG(hw, E1000_RCTL);
@@ -1808,15 +2262,29 @@ void igb_down(struct igb_adapter *adapter)
 	tctl = E1000_READ_REG(hw, E1000_TCTL);
 	tctl &= ~E1000_TCTL_EN;
 	E1000_WRITE_REG(hw, E1000_TCTL, tctl);
-	/* flush both disables and wait for them to finish */
+	/* flush both disables, the caller waits for them to finish */
 	E1000_WRITE_FLUSH(hw);
-	usleep_range(10000, 20000);
+}
+
+/**
+ * igb_down_finish - second half of igb_down
+ * @adapter: board private structure
+ *
+ * Masks interrupts, resets the hardware and cleans the rings.
+ **/
+static void igb_down_finish(struct igb_adapter *adapter)
+{
+	//int i;
 
 #ifndef __APPLE__
 	for (i = 0; i < adapter->num_q_vectors; i++)
 		napi_disable(&(adapter->q_vector[i]->napi));
 #endif
 	igb_irq_disable(adapter);
+#ifdef __APPLE__
+	/* wait for receive polls still running on the queue work loops */
+	adapter->netdev->syncQueueWorkLoops();
+#endif
 
 	adapter->flags &= ~IGB_FLAG_NEED_LINK_UPDATE;
 
@@ -1849,6 +2317,13 @@ void igb_down(struct igb_adapter *adapter)
 	igb_setup_dca(adapter);
 #endif
 }
+
+void igb_down(struct igb_adapter *adapter)
+{
+	igb_down_quiesce(adapter);
+	usleep_range(10000, 20000);
+	igb_down_finish(adapter);
+}
 	
 void igb_reinit_locked(struct igb_adapter *adapter)
 {
@@ -1889,6 +2364,8 @@ void igb_reset(struct igb_adapter *adapter)
 	struct e1000_mac_info *mac = &hw->mac;
 	struct e1000_fc_info *fc = &hw->fc;
 	u32 pba = 0, tx_space, min_tx_space, min_rx_space, hwm;
+
+	igb_phase_begin(adapter, IGB_PHASE_RESET);
 		
 	/* Repartition Pba for greater than 9k mtu
 	 * To take effect CTRL.RST is required.
@@ -1999,6 +2476,9 @@ void igb_reset(struct igb_adapter *adapter)
 	
 	if (adapter->flags & IGB_FLAG_MEDIA_RESET) {
 		e1000_setup_init_funcs(hw, TRUE);
+#ifdef __APPLE__
+		igb_nvm_shadow_hook(adapter);
+#endif
 		igb_check_options(adapter);
 		e1000_get_bus_info(hw);
 		adapter->flags &= ~IGB_FLAG_MEDIA_RESET;
@@ -2060,6 +2540,7 @@ void igb_reset(struct igb_adapter *adapter)
 	e1000_get_phy_info(hw);
 
 	adapter->devrc++;
+	igb_phase_end(adapter, IGB_PHASE_RESET);
 }
 
 #ifdef HAVE_NDO_SET_FEATURES
@@ -2428,6 +2909,7 @@ static int __devinit igb_sw_init(struct igb_adapter *adapter)
 	struct e1000_hw *hw = &adapter->hw;
 	IOEthernetController *netdev = adapter->netdev;
 	IOPCIDevice *pdev = adapter->pdev;
+	s32 err;
 
 	/* PCI config space info */
 
@@ -2452,7 +2934,10 @@ static int __devinit igb_sw_init(struct igb_adapter *adapter)
 					      VLAN_HLEN;
 
 	/* Initialize the hardware-specific values */
-	if (e1000_setup_init_funcs(hw, TRUE)) {
+	igb_phase_begin(adapter, IGB_PHASE_INIT_FUNCS);
+	err = e1000_setup_init_funcs(hw, TRUE);
+	igb_phase_end(adapter, IGB_PHASE_INIT_FUNCS);
+	if (err) {
 		pr_err( "Hardware Initialization Failure\n");
 		return -EIO;
 	}
@@ -2511,6 +2996,7 @@ int igb_open(IOEthernetController *netdev)
 
 	netif_carrier_off(netdev);
 	
+	igb_phase_begin(adapter, IGB_PHASE_RINGS);
 	/* allocate transmit descriptors */
 	err = igb_setup_all_tx_resources(adapter);
     if (err) {
@@ -2524,6 +3010,7 @@ int igb_open(IOEthernetController *netdev)
         pr_err("igb_setup_all_rx_resources failed\n");
         goto err_setup_rx;
     }
+	igb_phase_end(adapter, IGB_PHASE_RINGS);
 
 	igb_power_up_link(adapter);
     pr_debug("Powered up link.\n");
@@ -2532,7 +3019,9 @@ int igb_open(IOEthernetController *netdev)
 	 * Setting DEBUG_SHIRQ in the kernel makes it fire an interrupt
 	 * as soon as we call pci_request_irq, so we have to setup our
 	 * clean_rx handler before we do so.  */
+	igb_phase_begin(adapter, IGB_PHASE_CONFIGURE);
 	igb_configure(adapter);
+	igb_phase_end(adapter, IGB_PHASE_CONFIGURE);
 	
 	err = igb_request_irq(adapter);
     if (err) {
@@ -2788,6 +3277,11 @@ void igb_configure_tx_ring(struct igb_adapter *adapter,
 	ring->tail = adapter->io_addr + E1000_TDT(reg_idx);
 	E1000_WRITE_REG(hw, E1000_TDH(reg_idx), 0);
 	writel(0, ring->tail);
+#ifdef __APPLE__
+	ring->next_to_flush = 0;
+	ring->tx_pending = 0;
+	ring->tx_stopped = 0;
+#endif
 
 	txdctl |= IGB_TX_PTHRESH;
 	txdctl |= IGB_TX_HTHRESH << 8;
@@ -2811,30 +3305,226 @@ static void igb_configure_tx(struct igb_adapter *adapter)
 		igb_configure_tx_ring(adapter, adapter->tx_ring[i]);
 }
 
-/**
- * igb_setup_rx_resources - allocate Rx resources (Descriptors)
- * @rx_ring:    rx descriptor ring (for a specific queue) to setup
- *
- * Returns 0 on success, negative on failure
- **/
-int igb_setup_rx_resources(struct igb_ring *rx_ring)
+#ifdef __APPLE__
+/*
+ * Two IGB_RX_BUFSZ slots share every page, the way the Linux driver flips
+ * page_offset between the halves of a page, and a chunk holds a whole
+ * number of pages.  A ring of N descriptors therefore wires N * 2 KiB
+ * instead of N pages; WiredBytes in RxQueueStats shows the actual figure.
+ */
+static_assert(IGB_RX_BUFSZ * 2 == PAGE_SIZE, "two Rx buffers per page");
+static_assert(IGB_RX_POOL_CHUNK % PAGE_SIZE == 0, "Rx pool chunk not page sized");
+
+/* bytes of wired memory currently backing a receive pool */
+static inline u32 igb_rx_pool_wired(const struct igb_rx_pool *pool)
 {
-	//struct device *dev = rx_ring->dev;
-	//int orig_node = dev_to_node(dev);
-	int size, desc_len;
+	return pool->nchunks * IGB_RX_POOL_CHUNK;
+}
 
-	size = sizeof(struct igb_rx_buffer) * rx_ring->count;
-	rx_ring->rx_buffer_info = (igb_rx_buffer*)vzalloc(size);
-	if (!rx_ring->rx_buffer_info)
-		goto err;
+static void igb_rx_pool_put(struct igb_rx_slot *slot)
+{
+	struct igb_rx_pool *pool = slot->pool;
+	u32 index = (u32)(slot - pool->slots);
+	UInt64 old_head, new_head;
 
-	desc_len = sizeof(union e1000_adv_rx_desc);
+	do {
+		old_head = pool->free_head;
+		slot->next = (u32)old_head;
+		new_head = (((old_head >> 32) + 1) << 32) | index;
+	} while (!OSCompareAndSwap64(old_head, new_head, &pool->free_head));
+}
 
-	/* Round up to nearest 4K */
-	rx_ring->size = rx_ring->count * desc_len;
-	rx_ring->size = ALIGN(rx_ring->size, 4096);
-#ifdef __APPLE__
-	rx_ring->pool= IOBufferMemoryDescriptor::inTaskWithOptions( kernel_task,
+static struct igb_rx_slot *igb_rx_pool_pop(struct igb_rx_pool *pool)
+{
+	UInt64 old_head, new_head;
+	u32 index;
+
+	/* the generation in the upper half keeps a stale head from matching */
+	do {
+		old_head = pool->free_head;
+		index = (u32)old_head;
+		if (index == IGB_RX_POOL_NONE)
+			return NULL;
+		new_head = (((old_head >> 32) + 1) << 32) | pool->slots[index].next;
+	} while (!OSCompareAndSwap64(old_head, new_head, &pool->free_head));
+
+	return &pool->slots[index];
+}
+
+/* map one more chunk and put its slots on the free list */
+static bool igb_rx_pool_grow(struct igb_rx_pool *pool)
+{
+	IOBufferMemoryDescriptor *chunk;
+	struct igb_rx_slot *slot;
+	dma_addr_t dma;
+	u32 i, first;
+	u8 *va;
+
+	if (pool->nchunks >= pool->max_chunks)
+		return false;
+
+	chunk = IOBufferMemoryDescriptor::inTaskWithOptions( kernel_task,
+						kIODirectionInOut | kIOMemoryPhysicallyContiguous,
+						IGB_RX_POOL_CHUNK, PAGE_SIZE );
+	if (!chunk)
+		return false;
+	if (chunk->prepare() != kIOReturnSuccess) {
+		chunk->release();
+		return false;
+	}
+	va = (u8*)chunk->getBytesNoCopy();
+	dma = chunk->getPhysicalAddress();
+
+	first = pool->nchunks * IGB_RX_POOL_SLOTS;
+	for (i = 0; i < IGB_RX_POOL_SLOTS; i++) {
+		slot = &pool->slots[first + i];
+		slot->pool = pool;
+		slot->va = va + i * IGB_RX_BUFSZ;
+		slot->dma = dma + i * IGB_RX_BUFSZ;
+	}
+	pool->chunks[pool->nchunks++] = chunk;
+
+	for (i = 0; i < IGB_RX_POOL_SLOTS; i++)
+		igb_rx_pool_put(&pool->slots[first + i]);
+
+	return true;
+}
+
+/**
+ * igb_rx_pool_destroy - unmap a receive pool
+ * @pool: pool whose last reference is gone
+ *
+ * Runs once the ring and every loaned mbuf have let go, so each slot
+ * must be back on the free list; anything else is a slot lost or put
+ * twice, which is reported before the chunks go away.
+ **/
+static void igb_rx_pool_destroy(struct igb_rx_pool *pool)
+{
+	u32 i, idx, free = 0, total = pool->nchunks * IGB_RX_POOL_SLOTS;
+
+	for (idx = (u32)pool->free_head;
+	     idx != IGB_RX_POOL_NONE && free <= total;
+	     idx = pool->slots[idx].next)
+		free++;
+	if (free != total)
+		pr_err("Rx pool: %u of %u buffers on the free list at release\n",
+		       free, total);
+
+	for (i = 0; i < pool->nchunks; i++) {
+		pool->chunks[i]->complete();
+		pool->chunks[i]->release();
+	}
+	if (pool->slots)
+		kfree(pool->slots, sizeof(struct igb_rx_slot) *
+		      pool->max_chunks * IGB_RX_POOL_SLOTS);
+	if (pool->chunks)
+		kfree(pool->chunks, sizeof(IOBufferMemoryDescriptor *) * pool->max_chunks);
+	kfree(pool, sizeof(struct igb_rx_pool));
+}
+
+/**
+ * igb_rx_pool_create - allocate the receive buffer pool for a ring
+ * @count: number of descriptors in the ring
+ *
+ * Maps enough chunks up front to fill the ring once.  The pool grows on
+ * demand, up to IGB_RX_POOL_GROWTH times the ring size, while buffers are
+ * loaned to the stack.  Only the ring's refill grows it, on the queue
+ * work loop where mapping a chunk may block; the mbuf free routine can
+ * run in any context and only pushes slots back.
+ **/
+static struct igb_rx_pool *igb_rx_pool_create(u32 count)
+{
+	struct igb_rx_pool *pool;
+	u32 chunks = DIV_ROUND_UP(count, IGB_RX_POOL_SLOTS);
+
+	pool = (struct igb_rx_pool *)kzalloc(sizeof(struct igb_rx_pool));
+	if (!pool)
+		return NULL;
+
+	pool->free_head = IGB_RX_POOL_NONE;
+	pool->refcnt = 1;
+	pool->max_chunks = chunks * IGB_RX_POOL_GROWTH;
+	pool->chunks = (IOBufferMemoryDescriptor **)kcalloc(pool->max_chunks,
+				sizeof(IOBufferMemoryDescriptor *));
+	pool->slots = (struct igb_rx_slot *)kcalloc(pool->max_chunks * IGB_RX_POOL_SLOTS,
+				sizeof(struct igb_rx_slot));
+	if (!pool->chunks || !pool->slots)
+		goto err;
+
+	while (pool->nchunks < chunks) {
+		if (!igb_rx_pool_grow(pool))
+			goto err;
+	}
+	return pool;
+
+err:
+	igb_rx_pool_destroy(pool);
+	return NULL;
+}
+
+static void igb_rx_pool_release(struct igb_rx_pool *pool)
+{
+	if (OSDecrementAtomic(&pool->refcnt) == 1)
+		igb_rx_pool_destroy(pool);
+}
+
+static struct igb_rx_slot *igb_rx_pool_get(struct igb_ring *rx_ring)
+{
+	struct igb_rx_pool *pool = rx_ring->rx_pool;
+	struct igb_rx_slot *slot;
+
+	slot = igb_rx_pool_pop(pool);
+	if (likely(slot)) {
+		u64_stats_update_begin(&rx_ring->rx_syncp);
+		rx_ring->rx_stats.pool_hits++;
+		u64_stats_update_end(&rx_ring->rx_syncp);
+		return slot;
+	}
+
+	/* only the ring grows the pool, the free routine just pushes */
+	u64_stats_update_begin(&rx_ring->rx_syncp);
+	rx_ring->rx_stats.pool_misses++;
+	u64_stats_update_end(&rx_ring->rx_syncp);
+	if (!igb_rx_pool_grow(pool))
+		return NULL;
+	return igb_rx_pool_pop(pool);
+}
+
+/* mbuf external storage free routine for loaned receive buffers */
+static void igb_rx_slot_free(caddr_t buf, u_int size, caddr_t arg)
+{
+	struct igb_rx_slot *slot = (struct igb_rx_slot *)arg;
+	struct igb_rx_pool *pool = slot->pool;
+
+	igb_rx_pool_put(slot);
+	igb_rx_pool_release(pool);
+}
+#endif /* __APPLE__ */
+
+/**
+ * igb_setup_rx_resources - allocate Rx resources (Descriptors)
+ * @rx_ring:    rx descriptor ring (for a specific queue) to setup
+ *
+ * Returns 0 on success, negative on failure
+ **/
+int igb_setup_rx_resources(struct igb_ring *rx_ring)
+{
+	//struct device *dev = rx_ring->dev;
+	//int orig_node = dev_to_node(dev);
+	int size, desc_len;
+
+	size = sizeof(struct igb_rx_buffer) * rx_ring->count;
+	rx_ring->rx_buffer_info = (igb_rx_buffer*)vzalloc(size);
+	if (!rx_ring->rx_buffer_info)
+		goto err;
+
+	desc_len = sizeof(union e1000_adv_rx_desc);
+
+	/* Round up to nearest 4K */
+	rx_ring->size = rx_ring->count * desc_len;
+	rx_ring->size = ALIGN(rx_ring->size, 4096);
+#ifdef __APPLE__
+	rx_ring->pool= IOBufferMemoryDescriptor::inTaskWithOptions( kernel_task,
 								kIODirectionInOut | kIOMemoryPhysicallyContiguous,
 								(vm_size_t)(rx_ring->size), PAGE_SIZE );
 	
@@ -2843,6 +3533,40 @@ int igb_setup_rx_resources(struct igb_ring *rx_ring)
 	rx_ring->pool->prepare();
 	rx_ring->desc = rx_ring->pool->getBytesNoCopy();
 	rx_ring->dma = rx_ring->pool->getPhysicalAddress();
+
+	rx_ring->rx_pool = igb_rx_pool_create(rx_ring->count);
+	if (!rx_ring->rx_pool) {
+		rx_ring->pool->complete();
+		rx_ring->pool->release();
+		rx_ring->pool = NULL;
+		goto err;
+	}
+	/* headers of split frames land in a small buffer per descriptor */
+	if (rx_ring->netdev->rxHeaderSplit()) {
+		rx_ring->hdr_pool = IOBufferMemoryDescriptor::inTaskWithOptions( kernel_task,
+								kIODirectionInOut | kIOMemoryPhysicallyContiguous,
+								(vm_size_t)(rx_ring->count * IGB_RX_HDR_LEN), PAGE_SIZE );
+		if (rx_ring->hdr_pool &&
+		    rx_ring->hdr_pool->prepare() != kIOReturnSuccess) {
+			pr_err("Rx ring %u: header buffers could not be wired\n",
+			       rx_ring->queue_index);
+			rx_ring->hdr_pool->release();
+			rx_ring->hdr_pool = NULL;
+			igb_rx_pool_release(rx_ring->rx_pool);
+			rx_ring->rx_pool = NULL;
+			rx_ring->pool->complete();
+			rx_ring->pool->release();
+			rx_ring->pool = NULL;
+			goto err;
+		}
+		if (rx_ring->hdr_pool) {
+			rx_ring->hdr_va = (u8 *)rx_ring->hdr_pool->getBytesNoCopy();
+			rx_ring->hdr_dma = rx_ring->hdr_pool->getPhysicalAddress();
+		} else {
+			pr_err("Rx ring %u: no header buffers, header split off\n",
+			       rx_ring->queue_index);
+		}
+	}
 #else
 	rx_ring->desc = dma_alloc_coherent(dev,
 						   rx_ring->size,
@@ -3215,6 +3939,16 @@ void igb_configure_rx_ring(struct igb_adapter *adapter,
 	/* set descriptor configuration */
 	srrctl = IGB_RX_HDR_LEN << E1000_SRRCTL_BSIZEHDRSIZE_SHIFT;
 	srrctl |= IGB_RX_BUFSZ >> E1000_SRRCTL_BSIZEPKT_SHIFT;
+#ifdef __APPLE__
+	if (ring->hdr_va) {
+		/* L2 through L4 headers to the header buffer, payload to the slot */
+		srrctl |= E1000_SRRCTL_DESCTYPE_HDR_SPLIT_ALWAYS;
+		E1000_WRITE_REG(hw, E1000_PSRTYPE(adapter->vfs_allocated_count),
+				E1000_PSRTYPE_L2HDR |
+				E1000_PSRTYPE_IPV4HDR | E1000_PSRTYPE_IPV6HDR |
+				E1000_PSRTYPE_TCPHDR | E1000_PSRTYPE_UDPHDR);
+	} else
+#endif
 	srrctl |= E1000_SRRCTL_DESCTYPE_ADV_ONEBUF;
 #ifdef HAVE_PTP_1588_CLOCK
 	if (hw->mac.type >= e1000_82580)
@@ -3412,6 +4146,18 @@ void igb_free_rx_resources(struct igb_ring *rx_ring)
 		rx_ring->pool->release();
 		rx_ring->pool = NULL;
 	}
+	if (rx_ring->hdr_pool) {
+		rx_ring->hdr_pool->complete();
+		rx_ring->hdr_pool->release();
+		rx_ring->hdr_pool = NULL;
+		rx_ring->hdr_va = NULL;
+		rx_ring->hdr_dma = 0;
+	}
+	/* buffers still loaned to the stack keep the pool alive */
+	if (rx_ring->rx_pool) {
+		igb_rx_pool_release(rx_ring->rx_pool);
+		rx_ring->rx_pool = NULL;
+	}
 #else
 	dma_free_coherent(rx_ring->dev, rx_ring->size,
 			  rx_ring->desc, rx_ring->dma);
@@ -3453,6 +4199,10 @@ void igb_clean_rx_ring(struct igb_ring *rx_ring)
 		dev_kfree_skb(rx_ring->skb);
 #endif
 	rx_ring->skb = NULL;
+#ifdef	__APPLE__
+	rx_ring->skb_tail = NULL;
+	rx_ring->skb_failed = false;
+#endif
 	
 	/* Free all the Rx ring sk_buffs */
 	for (i = 0; i < rx_ring->count; i++) {
@@ -3461,8 +4211,7 @@ void igb_clean_rx_ring(struct igb_ring *rx_ring)
 			continue;
         
 #ifdef __APPLE__
-        buffer_info->page->complete();
-        buffer_info->page->release();
+        igb_rx_pool_put(buffer_info->page);
 #else
 		dma_unmap_page(rx_ring->dev,
                        buffer_info->dma,
@@ -4129,6 +4878,113 @@ set_itr_now:
 	}
 }
 
+#ifdef __APPLE__
+static void igb_itr_tiered_update(struct igb_q_vector *q_vector)
+{
+	struct igb_adapter *adapter = q_vector->adapter;
+
+	if ((adapter->num_q_vectors == 1) && !adapter->vf_data)
+		igb_set_itr(q_vector);
+	else
+		igb_update_ring_itr(q_vector);
+}
+
+/**
+ * igb_itr_target_next - one step of the target packets controller
+ * @itr_val: current interval, in EITR units
+ * @packets: packets cleaned since the vector was last armed
+ * @target: packets per interrupt to aim for
+ * @min_itr: shortest interval allowed
+ *
+ *      Depends on nothing but its arguments.  At a steady packet rate r
+ *      per EITR unit, packets is r * itr_val and the step reduces to
+ *      itr' = (3 * itr + target / r) / 4, so the distance to the fixed
+ *      point target / r shrinks by a quarter on every arm; even from the
+ *      far end of the 4K..70K range it is within 10% in under twenty
+ *      arms.  With arrivals at a random phase to the interval it settles
+ *      on that point; when they lock to it, whole packet counts leave it
+ *      up to 1 / target above.  A fixed point outside [min_itr,
+ *      IGB_4K_ITR] is clamped to the nearer bound.  At two packets or
+ *      fewer per arm it sits at min_itr, the request/response case, so a
+ *      rate under three packets per min_itr stays there even when its
+ *      fixed point is longer, as in the tiered lowest_latency state.
+ **/
+static u32 igb_itr_target_next(u32 itr_val, u32 packets, u32 target,
+			       u32 min_itr)
+{
+	u32 new_val;
+
+	if (packets <= 2)
+		return min_itr;
+	new_val = (3 * itr_val + itr_val * target / packets) / 4;
+	return max_t(u32, min_itr, min_t(u32, new_val, IGB_4K_ITR));
+}
+
+/**
+ * igb_itr_target_update - steer the ITR towards a packets per irq target
+ * @q_vector: pointer to q_vector
+ *
+ *      Scales the interval by itr_target over the packets cleaned since
+ *      the vector was last armed, averaged 3:1 with the current value so
+ *      one odd interrupt does not swing it.  A trickle of one or two
+ *      packets is treated as request/response traffic and gets the
+ *      shortest interval.  The result stays between the 70K and 4K tiers
+ *      of igb_set_itr, so added latency is never above the tiered worst
+ *      case.
+ **/
+static void igb_itr_target_update(struct igb_q_vector *q_vector)
+{
+	struct igb_adapter *adapter = q_vector->adapter;
+	u32 packets = q_vector->rx.total_packets + q_vector->tx.total_packets;
+	u32 min_itr = IGB_70K_ITR;
+	u32 new_val;
+
+	/* for non-gigabit speeds, just fix the interrupt rate at 4000 */
+	switch (adapter->link_speed) {
+		case SPEED_10:
+		case SPEED_100:
+			new_val = IGB_4K_ITR;
+			goto set_itr_val;
+		default:
+			break;
+	}
+
+	/* no work, keep the current rate */
+	if (!packets)
+		return;
+
+	/* conservative mode (itr 3) eliminates the lowest_latency setting */
+	if ((q_vector->rx.ring && adapter->rx_itr_setting == 3) ||
+	    (!q_vector->rx.ring && adapter->tx_itr_setting == 3))
+		min_itr = IGB_20K_ITR;
+
+	new_val = igb_itr_target_next(q_vector->itr_val, packets,
+				      adapter->itr_target, min_itr);
+
+set_itr_val:
+	if (new_val != q_vector->itr_val) {
+		q_vector->itr_val = new_val;
+		q_vector->set_itr = 1;
+	}
+	q_vector->rx.total_bytes = 0;
+	q_vector->rx.total_packets = 0;
+	q_vector->tx.total_bytes = 0;
+	q_vector->tx.total_packets = 0;
+}
+
+static const struct igb_itr_ops igb_itr_controllers[] = {
+	{ "tiered", igb_itr_tiered_update },	/* IGB_ITR_TIERED */
+	{ "target", igb_itr_target_update },	/* IGB_ITR_TARGET */
+};
+
+static const struct igb_itr_ops *igb_itr_controller(u32 itr_ctl)
+{
+	if (itr_ctl >= sizeof(igb_itr_controllers) / sizeof(igb_itr_controllers[0]))
+		itr_ctl = IGB_ITR_TIERED;
+	return &igb_itr_controllers[itr_ctl];
+}
+#endif /* __APPLE__ */
+
 void igb_tx_ctxtdesc(struct igb_ring *tx_ring, u32 vlan_macip_lens,
 		     u32 type_tucmd, u32 mss_l4len_idx)
 {
@@ -4683,11 +5539,16 @@ static bool igb_tx_map(struct igb_ring *tx_ring,
 
 	tx_ring->next_to_use = i;
 
+#ifdef __APPLE__
+	/* outputPacket rings the doorbell, possibly once for a whole burst */
+	tx_ring->tx_pending++;
+#else
 	writel(i, tx_ring->tail);
 
 	/* we need this if more than one processor can write to our tail
 	 * at a time, it syncronizes IO on IA64/Altix systems */
 	mmiowb();
+#endif
 
 	return TRUE;
 #ifndef __APPLE__
@@ -4752,6 +5613,47 @@ static inline int igb_maybe_stop_tx(struct igb_ring *tx_ring, const u16 size)
 	return __igb_maybe_stop_tx(tx_ring, size);
 }
 
+#ifdef __APPLE__
+/* descriptors filled by igb_tx_map that the hardware was not told about */
+static inline u16 igb_tx_unflushed(struct igb_ring *tx_ring)
+{
+	u16 i = tx_ring->next_to_use;
+
+	if (i < tx_ring->next_to_flush)
+		i += tx_ring->count;
+	return i - tx_ring->next_to_flush;
+}
+
+/**
+ * igb_tx_flush - ring the Tx doorbell for pending descriptors
+ * @tx_ring: ring to flush
+ *
+ * igb_tx_map leaves the tail alone on macOS; outputPacket calls this once
+ * enough descriptors are pending or the output queue runs dry, and the
+ * Tx flush timer catches anything left behind.
+ **/
+static void igb_tx_flush(struct igb_ring *tx_ring)
+{
+	u16 i = tx_ring->next_to_use;
+
+	if (i == tx_ring->next_to_flush)
+		return;
+
+	writel(i, tx_ring->tail);
+
+	/* we need this if more than one processor can write to our tail
+	 * at a time, it syncronizes IO on IA64/Altix systems */
+	mmiowb();
+
+	tx_ring->next_to_flush = i;
+	u64_stats_update_begin(&tx_ring->tx_syncp2);
+	tx_ring->tx_submit_stats.doorbells++;
+	tx_ring->tx_submit_stats.doorbell_pkts += tx_ring->tx_pending;
+	u64_stats_update_end(&tx_ring->tx_syncp2);
+	tx_ring->tx_pending = 0;
+}
+#endif
+
 #ifndef __APPLE__	// see outputPacket()
 netdev_tx_t igb_xmit_frame_ring(struct igb_adapter *adapter,struct sk_buff *skb,
 				struct igb_ring *tx_ring)
@@ -4855,6 +5757,76 @@ static inline struct igb_ring *igb_tx_queue_mapping(struct igb_adapter *adapter,
 
 	return adapter->tx_ring[r_idx];
 }
+#elif defined(__APPLE__)
+/**
+ * igb_tx_flow_hash - hash the flow a frame belongs to
+ * @skb: frame about to be transmitted
+ *
+ * Mixes the IP addresses and, for TCP/UDP, the ports found in the first
+ * mbuf, so all packets of a connection use the same Tx ring and stay in
+ * order.  Non-IP frames and frames with split headers hash to 0.
+ **/
+static u32 igb_tx_flow_hash(mbuf_t skb)
+{
+	u8 *data = (u8 *)mbuf_data(skb);
+	size_t len = mbuf_len(skb);
+	struct ether_header *eh = (struct ether_header *)data;
+	u32 hash, *addr;
+	size_t l4;
+	u8 proto;
+	int i;
+
+	if (len < ETHER_HDR_LEN + sizeof(struct ip))
+		return 0;
+
+	switch (ntohs(eh->ether_type)) {
+	case ETHERTYPE_IP: {
+		struct ip *iph = (struct ip *)(data + ETHER_HDR_LEN);
+
+		hash = iph->ip_src.s_addr ^ iph->ip_dst.s_addr;
+		proto = iph->ip_p;
+		/* only the first fragment carries the ports */
+		if (ntohs(iph->ip_off) & (IP_MF | IP_OFFMASK))
+			proto = 0;
+		l4 = ETHER_HDR_LEN + (iph->ip_hl << 2);
+		break;
+	}
+	case ETHERTYPE_IPV6: {
+		struct ip6_hdr *ip6 = (struct ip6_hdr *)(data + ETHER_HDR_LEN);
+
+		if (len < ETHER_HDR_LEN + sizeof(struct ip6_hdr))
+			return 0;
+		/* source and destination address are adjacent */
+		addr = (u32 *)&ip6->ip6_src;
+		for (hash = 0, i = 0; i < 8; i++)
+			hash ^= addr[i];
+		proto = ip6->ip6_nxt;
+		l4 = ETHER_HDR_LEN + sizeof(struct ip6_hdr);
+		break;
+	}
+	default:
+		return 0;
+	}
+
+	/* source and destination port */
+	if ((proto == IPPROTO_TCP || proto == IPPROTO_UDP) && len >= l4 + 4)
+		hash ^= *(u32 *)(data + l4);
+
+	/* fold so the low bits depend on every input bit */
+	hash ^= hash >> 16;
+	hash *= 0x45d9f3b;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+static inline struct igb_ring *igb_tx_queue_mapping(struct igb_adapter *adapter,
+                                                    mbuf_t skb)
+{
+	if (adapter->num_tx_queues == 1)
+		return adapter->tx_ring[0];
+
+	return adapter->tx_ring[igb_tx_flow_hash(skb) % adapter->num_tx_queues];
+}
 #else
 #define igb_tx_queue_mapping(_adapter, _skb) ((_adapter)->tx_ring[0])
 #endif
@@ -4981,11 +5953,23 @@ static int igb_change_mtu(IOEthernetController *netdev, int new_mtu)
 }
 
 /**
- * igb_update_stats - Update the board statistics counters
+ * __igb_update_stats - Update the board statistics counters
  * @adapter: board private structure
+ * @rare: also read the error, size bucket and management counters
+ *
+ * The hot counters (packets, octets, drops) are read on every call.  The
+ * rest only change on errors or are informational, so the periodic pass
+ * from the watchdog reads them every IGB_STATS_RARE_TICKS calls.  All of
+ * them are clear-on-read and accumulate into 64 bit fields here, which
+ * only the controller work loop writes.
  **/
+#ifdef __APPLE__
+#define IGB_STAT_READ(reg)	(adapter->stats_reads++, E1000_READ_REG(hw, reg))
+#else
+#define IGB_STAT_READ(reg)	E1000_READ_REG(hw, reg)
+#endif
 
-void igb_update_stats(struct igb_adapter *adapter)
+static void __igb_update_stats(struct igb_adapter *adapter, bool rare)
 {
 	IONetworkStats * net_stats = adapter->netdev->getNetStats();
 	IOEthernetStats * ether_stats = adapter->netdev->getEtherStats();
@@ -4997,6 +5981,8 @@ void igb_update_stats(struct igb_adapter *adapter)
 	u16 phy_tmp;
 	int i;
 	u64 bytes, packets;
+	u64 _bytes, _packets;
+	unsigned int start;
 #ifndef IGB_NO_LRO
 	u32 flushed = 0, coal = 0;
 	struct igb_q_vector *q_vector;
@@ -5031,14 +6017,21 @@ void igb_update_stats(struct igb_adapter *adapter)
 	packets = 0;
 	for (i = 0; i < adapter->num_rx_queues; i++) {
 		struct igb_ring *ring = adapter->rx_ring[i];
-		u32 rqdpc_tmp = E1000_READ_REG(hw, E1000_RQDPC(i)) & 0x0FFF;
+		u32 rqdpc_tmp = IGB_STAT_READ(E1000_RQDPC(i)) & 0x0FFF;
 		if (hw->mac.type >= e1000_i210)
 			E1000_WRITE_REG(hw, E1000_RQDPC(i), 0);
-		ring->rx_stats.drops += rqdpc_tmp;
+		u64_stats_update_begin(&ring->rx_syncp2);
+		ring->rx_drops += rqdpc_tmp;
+		u64_stats_update_end(&ring->rx_syncp2);
 		ether_stats->dot3RxExtraEntry.overruns += rqdpc_tmp;
 		
-		bytes += ring->rx_stats.bytes;
-		packets += ring->rx_stats.packets;
+		do {
+			start = u64_stats_fetch_begin(&ring->rx_syncp);
+			_bytes = ring->rx_stats.bytes;
+			_packets = ring->rx_stats.packets;
+		} while (u64_stats_fetch_retry(&ring->rx_syncp, start));
+		bytes += _bytes;
+		packets += _packets;
 	}
 	
 	//net_stats->rx_bytes = bytes;
@@ -5048,92 +6041,124 @@ void igb_update_stats(struct igb_adapter *adapter)
 	packets = 0;
 	for (i = 0; i < adapter->num_tx_queues; i++) {
 		struct igb_ring *ring = adapter->tx_ring[i];
-		bytes += ring->tx_stats.bytes;
-		packets += ring->tx_stats.packets;
+		do {
+			start = u64_stats_fetch_begin(&ring->tx_syncp);
+			_bytes = ring->tx_stats.bytes;
+			_packets = ring->tx_stats.packets;
+		} while (u64_stats_fetch_retry(&ring->tx_syncp, start));
+		bytes += _bytes;
+		packets += _packets;
 	}
 	//net_stats->tx_bytes = bytes;
 	net_stats->outputPackets = packets;
 	
-	/* read stats registers */
-	adapter->stats.crcerrs += E1000_READ_REG(hw, E1000_CRCERRS);
-	adapter->stats.gprc += E1000_READ_REG(hw, E1000_GPRC);
-	adapter->stats.gorc += E1000_READ_REG(hw, E1000_GORCL);
-	E1000_READ_REG(hw, E1000_GORCH); /* clear GORCL */
-	adapter->stats.bprc += E1000_READ_REG(hw, E1000_BPRC);
-	adapter->stats.mprc += E1000_READ_REG(hw, E1000_MPRC);
-	adapter->stats.roc += E1000_READ_REG(hw, E1000_ROC);
-	
-	adapter->stats.prc64 += E1000_READ_REG(hw, E1000_PRC64);
-	adapter->stats.prc127 += E1000_READ_REG(hw, E1000_PRC127);
-	adapter->stats.prc255 += E1000_READ_REG(hw, E1000_PRC255);
-	adapter->stats.prc511 += E1000_READ_REG(hw, E1000_PRC511);
-	adapter->stats.prc1023 += E1000_READ_REG(hw, E1000_PRC1023);
-	adapter->stats.prc1522 += E1000_READ_REG(hw, E1000_PRC1522);
-	adapter->stats.symerrs += E1000_READ_REG(hw, E1000_SYMERRS);
-	adapter->stats.sec += E1000_READ_REG(hw, E1000_SEC);
-	
-	mpc = E1000_READ_REG(hw, E1000_MPC);
+	/* read stats registers; for the octet counters read the low half
+	 * first, reading the high half clears both */
+	adapter->stats.gprc += IGB_STAT_READ(E1000_GPRC);
+	adapter->stats.gorc += IGB_STAT_READ(E1000_GORCL);
+	adapter->stats.gorc += (u64)IGB_STAT_READ(E1000_GORCH) << 32;
+	adapter->stats.gptc += IGB_STAT_READ(E1000_GPTC);
+	adapter->stats.gotc += IGB_STAT_READ(E1000_GOTCL);
+	adapter->stats.gotc += (u64)IGB_STAT_READ(E1000_GOTCH) << 32;
+	
+	mpc = IGB_STAT_READ(E1000_MPC);
 	adapter->stats.mpc += mpc;
 	ether_stats->dot3RxExtraEntry.overruns += mpc;
-	adapter->stats.scc += E1000_READ_REG(hw, E1000_SCC);
-	adapter->stats.ecol += E1000_READ_REG(hw, E1000_ECOL);
-	adapter->stats.mcc += E1000_READ_REG(hw, E1000_MCC);
-	adapter->stats.latecol += E1000_READ_REG(hw, E1000_LATECOL);
-	adapter->stats.dc += E1000_READ_REG(hw, E1000_DC);
-	adapter->stats.rlec += E1000_READ_REG(hw, E1000_RLEC);
-	adapter->stats.xonrxc += E1000_READ_REG(hw, E1000_XONRXC);
-	adapter->stats.xontxc += E1000_READ_REG(hw, E1000_XONTXC);
-	adapter->stats.xoffrxc += E1000_READ_REG(hw, E1000_XOFFRXC);
-	adapter->stats.xofftxc += E1000_READ_REG(hw, E1000_XOFFTXC);
-	adapter->stats.fcruc += E1000_READ_REG(hw, E1000_FCRUC);
-	adapter->stats.gptc += E1000_READ_REG(hw, E1000_GPTC);
-	adapter->stats.gotc += E1000_READ_REG(hw, E1000_GOTCL);
-	E1000_READ_REG(hw, E1000_GOTCH); /* clear GOTCL */
-	adapter->stats.rnbc += E1000_READ_REG(hw, E1000_RNBC);
-	adapter->stats.ruc += E1000_READ_REG(hw, E1000_RUC);
-	adapter->stats.rfc += E1000_READ_REG(hw, E1000_RFC);
-	adapter->stats.rjc += E1000_READ_REG(hw, E1000_RJC);
-	adapter->stats.tor += E1000_READ_REG(hw, E1000_TORH);
-	adapter->stats.tot += E1000_READ_REG(hw, E1000_TOTH);
-	adapter->stats.tpr += E1000_READ_REG(hw, E1000_TPR);
-	
-	adapter->stats.ptc64 += E1000_READ_REG(hw, E1000_PTC64);
-	adapter->stats.ptc127 += E1000_READ_REG(hw, E1000_PTC127);
-	adapter->stats.ptc255 += E1000_READ_REG(hw, E1000_PTC255);
-	adapter->stats.ptc511 += E1000_READ_REG(hw, E1000_PTC511);
-	adapter->stats.ptc1023 += E1000_READ_REG(hw, E1000_PTC1023);
-	adapter->stats.ptc1522 += E1000_READ_REG(hw, E1000_PTC1522);
-	
-	adapter->stats.mptc += E1000_READ_REG(hw, E1000_MPTC);
-	adapter->stats.bptc += E1000_READ_REG(hw, E1000_BPTC);
-	
-	adapter->stats.tpt += E1000_READ_REG(hw, E1000_TPT);
-	adapter->stats.colc += E1000_READ_REG(hw, E1000_COLC);
-	
-	adapter->stats.algnerrc += E1000_READ_REG(hw, E1000_ALGNERRC);
-	/* read internal phy sepecific stats */
-	reg = E1000_READ_REG(hw, E1000_CTRL_EXT);
-	if (!(reg & E1000_CTRL_EXT_LINK_MODE_MASK)) {
-		adapter->stats.rxerrc += E1000_READ_REG(hw, E1000_RXERRC);
-		
-		/* this stat has invalid values on i210/i211 */
-		if ((hw->mac.type != e1000_i210) &&
-			(hw->mac.type != e1000_i211))
-			adapter->stats.tncrs += E1000_READ_REG(hw, E1000_TNCRS);
-	}
-	
-	adapter->stats.tsctc += E1000_READ_REG(hw, E1000_TSCTC);
-	adapter->stats.tsctfc += E1000_READ_REG(hw, E1000_TSCTFC);
-	
-	adapter->stats.iac += E1000_READ_REG(hw, E1000_IAC);
-	adapter->stats.icrxoc += E1000_READ_REG(hw, E1000_ICRXOC);
-	adapter->stats.icrxptc += E1000_READ_REG(hw, E1000_ICRXPTC);
-	adapter->stats.icrxatc += E1000_READ_REG(hw, E1000_ICRXATC);
-	adapter->stats.ictxptc += E1000_READ_REG(hw, E1000_ICTXPTC);
-	adapter->stats.ictxatc += E1000_READ_REG(hw, E1000_ICTXATC);
-	adapter->stats.ictxqec += E1000_READ_REG(hw, E1000_ICTXQEC);
-	adapter->stats.ictxqmtc += E1000_READ_REG(hw, E1000_ICTXQMTC);
-	adapter->stats.icrxdmtc += E1000_READ_REG(hw, E1000_ICRXDMTC);
+	adapter->stats.rnbc += IGB_STAT_READ(E1000_RNBC);
+	
+	if (rare) {
+		adapter->stats.crcerrs += IGB_STAT_READ(E1000_CRCERRS);
+		adapter->stats.bprc += IGB_STAT_READ(E1000_BPRC);
+		adapter->stats.mprc += IGB_STAT_READ(E1000_MPRC);
+		adapter->stats.roc += IGB_STAT_READ(E1000_ROC);
+		
+		adapter->stats.prc64 += IGB_STAT_READ(E1000_PRC64);
+		adapter->stats.prc127 += IGB_STAT_READ(E1000_PRC127);
+		adapter->stats.prc255 += IGB_STAT_READ(E1000_PRC255);
+		adapter->stats.prc511 += IGB_STAT_READ(E1000_PRC511);
+		adapter->stats.prc1023 += IGB_STAT_READ(E1000_PRC1023);
+		adapter->stats.prc1522 += IGB_STAT_READ(E1000_PRC1522);
+		adapter->stats.symerrs += IGB_STAT_READ(E1000_SYMERRS);
+		adapter->stats.sec += IGB_STAT_READ(E1000_SEC);
+		
+		adapter->stats.scc += IGB_STAT_READ(E1000_SCC);
+		adapter->stats.ecol += IGB_STAT_READ(E1000_ECOL);
+		adapter->stats.mcc += IGB_STAT_READ(E1000_MCC);
+		adapter->stats.latecol += IGB_STAT_READ(E1000_LATECOL);
+		adapter->stats.dc += IGB_STAT_READ(E1000_DC);
+		adapter->stats.rlec += IGB_STAT_READ(E1000_RLEC);
+		adapter->stats.xonrxc += IGB_STAT_READ(E1000_XONRXC);
+		adapter->stats.xontxc += IGB_STAT_READ(E1000_XONTXC);
+		adapter->stats.xoffrxc += IGB_STAT_READ(E1000_XOFFRXC);
+		adapter->stats.xofftxc += IGB_STAT_READ(E1000_XOFFTXC);
+		adapter->stats.fcruc += IGB_STAT_READ(E1000_FCRUC);
+		adapter->stats.ruc += IGB_STAT_READ(E1000_RUC);
+		adapter->stats.rfc += IGB_STAT_READ(E1000_RFC);
+		adapter->stats.rjc += IGB_STAT_READ(E1000_RJC);
+		adapter->stats.tor += IGB_STAT_READ(E1000_TORL);
+		adapter->stats.tor += (u64)IGB_STAT_READ(E1000_TORH) << 32;
+		adapter->stats.tot += IGB_STAT_READ(E1000_TOTL);
+		adapter->stats.tot += (u64)IGB_STAT_READ(E1000_TOTH) << 32;
+		adapter->stats.tpr += IGB_STAT_READ(E1000_TPR);
+		
+		adapter->stats.ptc64 += IGB_STAT_READ(E1000_PTC64);
+		adapter->stats.ptc127 += IGB_STAT_READ(E1000_PTC127);
+		adapter->stats.ptc255 += IGB_STAT_READ(E1000_PTC255);
+		adapter->stats.ptc511 += IGB_STAT_READ(E1000_PTC511);
+		adapter->stats.ptc1023 += IGB_STAT_READ(E1000_PTC1023);
+		adapter->stats.ptc1522 += IGB_STAT_READ(E1000_PTC1522);
+		
+		adapter->stats.mptc += IGB_STAT_READ(E1000_MPTC);
+		adapter->stats.bptc += IGB_STAT_READ(E1000_BPTC);
+		
+		adapter->stats.tpt += IGB_STAT_READ(E1000_TPT);
+		adapter->stats.colc += IGB_STAT_READ(E1000_COLC);
+		
+		adapter->stats.algnerrc += IGB_STAT_READ(E1000_ALGNERRC);
+		/* read internal phy sepecific stats; CTRL_EXT is not a
+		 * counter, so it stays out of stats_reads */
+		reg = E1000_READ_REG(hw, E1000_CTRL_EXT);
+		if (!(reg & E1000_CTRL_EXT_LINK_MODE_MASK)) {
+			adapter->stats.rxerrc += IGB_STAT_READ(E1000_RXERRC);
+		
+			/* this stat has invalid values on i210/i211 */
+			if ((hw->mac.type != e1000_i210) &&
+				(hw->mac.type != e1000_i211))
+				adapter->stats.tncrs += IGB_STAT_READ(E1000_TNCRS);
+		}
+		
+		adapter->stats.tsctc += IGB_STAT_READ(E1000_TSCTC);
+		adapter->stats.tsctfc += IGB_STAT_READ(E1000_TSCTFC);
+		
+		adapter->stats.iac += IGB_STAT_READ(E1000_IAC);
+		adapter->stats.icrxoc += IGB_STAT_READ(E1000_ICRXOC);
+		adapter->stats.icrxptc += IGB_STAT_READ(E1000_ICRXPTC);
+		adapter->stats.icrxatc += IGB_STAT_READ(E1000_ICRXATC);
+		adapter->stats.ictxptc += IGB_STAT_READ(E1000_ICTXPTC);
+		adapter->stats.ictxatc += IGB_STAT_READ(E1000_ICTXATC);
+		adapter->stats.ictxqec += IGB_STAT_READ(E1000_ICTXQEC);
+		adapter->stats.ictxqmtc += IGB_STAT_READ(E1000_ICTXQMTC);
+		adapter->stats.icrxdmtc += IGB_STAT_READ(E1000_ICRXDMTC);
+		
+		/* Phy Stats */
+		if (hw->phy.media_type == e1000_media_type_copper) {
+			if ((adapter->link_speed == SPEED_1000) &&
+				(!e1000_read_phy_reg(hw, PHY_1000T_STATUS, &phy_tmp))) {
+				phy_tmp &= PHY_IDLE_ERROR_COUNT_MASK;
+				adapter->phy_stats.idle_errors += phy_tmp;
+			}
+		}
+		
+		/* Management Stats */
+		adapter->stats.mgptc += IGB_STAT_READ(E1000_MGTPTC);
+		adapter->stats.mgprc += IGB_STAT_READ(E1000_MGTPRC);
+		if (hw->mac.type > e1000_82580) {
+			adapter->stats.o2bgptc += IGB_STAT_READ(E1000_O2BGPTC);
+			adapter->stats.o2bspc += IGB_STAT_READ(E1000_O2BSPC);
+			adapter->stats.b2ospc += IGB_STAT_READ(E1000_B2OSPC);
+			adapter->stats.b2ogprc += IGB_STAT_READ(E1000_B2OGPRC);
+		}
+	}
 	
 	/* Fill out the OS statistics structure */
 	//net_stats->multicast = adapter->stats.mprc;
@@ -5161,27 +6186,52 @@ void igb_update_stats(struct igb_adapter *adapter)
 	ether_stats->dot3StatsEntry.carrierSenseErrors = (u32)adapter->stats.tncrs;
 	
 	/* Tx Dropped needs to be maintained elsewhere */
-	
-	/* Phy Stats */
-	if (hw->phy.media_type == e1000_media_type_copper) {
-		if ((adapter->link_speed == SPEED_1000) &&
-			(!e1000_read_phy_reg(hw, PHY_1000T_STATUS, &phy_tmp))) {
-			phy_tmp &= PHY_IDLE_ERROR_COUNT_MASK;
-			adapter->phy_stats.idle_errors += phy_tmp;
-		}
-	}
-	
-	/* Management Stats */
-	adapter->stats.mgptc += E1000_READ_REG(hw, E1000_MGTPTC);
-	adapter->stats.mgprc += E1000_READ_REG(hw, E1000_MGTPRC);
-	if (hw->mac.type > e1000_82580) {
-		adapter->stats.o2bgptc += E1000_READ_REG(hw, E1000_O2BGPTC);
-		adapter->stats.o2bspc += E1000_READ_REG(hw, E1000_O2BSPC);
-		adapter->stats.b2ospc += E1000_READ_REG(hw, E1000_B2OSPC);
-		adapter->stats.b2ogprc += E1000_READ_REG(hw, E1000_B2OGPRC);
-	}
 }
 
+#undef IGB_STAT_READ
+
+/**
+ * igb_update_stats - Update the board statistics counters
+ * @adapter: board private structure
+ **/
+#ifdef __APPLE__
+/* time one pass, the totals are published as "StatsPasses" */
+static void igb_update_stats_timed(struct igb_adapter *adapter, bool rare)
+{
+	u64 start = mach_absolute_time(), ns;
+
+	__igb_update_stats(adapter, rare);
+	absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+	adapter->stats_passes[rare]++;
+	adapter->stats_ns[rare] += ns;
+}
+#endif
+
+void igb_update_stats(struct igb_adapter *adapter)
+{
+#ifdef __APPLE__
+	igb_update_stats_timed(adapter, true);
+#else
+	__igb_update_stats(adapter, true);
+#endif
+}
+
+#ifdef __APPLE__
+/**
+ * igb_update_stats_periodic - watchdog statistics pass
+ * @adapter: board private structure
+ *
+ * Hot counters every call, everything else every IGB_STATS_RARE_TICKS.
+ * igb_down_finish still calls igb_update_stats for a full read before
+ * the reset clears the counters.
+ **/
+void igb_update_stats_periodic(struct igb_adapter *adapter)
+{
+	igb_update_stats_timed(adapter,
+			       !(adapter->stats_ticks++ % IGB_STATS_RARE_TICKS));
+}
+#endif
+
 	
 #ifndef __APPLE__
 static irqreturn_t igb_msix_other(int irq, void *data)
@@ -6196,10 +7246,14 @@ void igb_ring_irq_enable(struct igb_q_vector *q_vector)
 
 	if ((q_vector->rx.ring && (adapter->rx_itr_setting & 3)) ||
 	    (!q_vector->rx.ring && (adapter->tx_itr_setting & 3))) {
+#ifdef __APPLE__
+		q_vector->itr_ops->update(q_vector);
+#else
 		if ((adapter->num_q_vectors == 1) && !adapter->vf_data)
 			igb_set_itr(q_vector);
 		else
 			igb_update_ring_itr(q_vector);
+#endif
 	}
 
 	if (!test_bit(__IGB_DOWN, &adapter->state)) {
@@ -6235,15 +7289,16 @@ static int igb_poll(struct igb_q_vector *q_vector, int budget)
 		clean_complete = true;
 
 #endif
-#ifndef __APPLE__
 	/* If all work not completed, return budget and keep polling */
 	if (!clean_complete)
 		return budget;
 
+#ifndef __APPLE__
 	/* If not enough Rx work done, exit the polling mode */
 	napi_complete(napi);
-#endif
 	igb_ring_irq_enable(q_vector);
+#endif
+	/* pollQueueVector re-arms the vector, possibly after busy polling */
 	return 0;
 }
 
@@ -6355,8 +7410,10 @@ static bool igb_clean_tx_irq(struct igb_q_vector *q_vector)
 #endif
 	i += tx_ring->count;
 	tx_ring->next_to_clean = i;
+	u64_stats_update_begin(&tx_ring->tx_syncp);
 	tx_ring->tx_stats.bytes += total_bytes;
 	tx_ring->tx_stats.packets += total_packets;
+	u64_stats_update_end(&tx_ring->tx_syncp);
 	q_vector->tx.total_bytes += total_bytes;
 	q_vector->tx.total_packets += total_packets;
 
@@ -6407,7 +7464,7 @@ static bool igb_clean_tx_irq(struct igb_q_vector *q_vector)
 				tx_buffer->next_to_watch,
 				tx_buffer->next_to_watch->wb.status);
 #ifdef	__APPLE__
-				netif_stop_queue(netdev_ring(tx_ring));
+				netdev_ring(tx_ring)->scheduleReset();
 #else
 				if (netif_is_multiqueue(netdev_ring(tx_ring)))
 				netif_stop_subqueue(netdev_ring(tx_ring),
@@ -6420,7 +7477,11 @@ static bool igb_clean_tx_irq(struct igb_q_vector *q_vector)
 		}
 	}
 
+#ifdef __APPLE__
+#define TX_WAKE_THRESHOLD IGB_TX_WAKE_THRESH(tx_ring)
+#else
 #define TX_WAKE_THRESHOLD (DESC_NEEDED * 2)
+#endif
 	if (unlikely(total_packets &&
 		     netif_carrier_ok(netdev_ring(tx_ring)) &&
 		     igb_desc_unused(tx_ring) >= TX_WAKE_THRESHOLD)) {
@@ -6429,10 +7490,12 @@ static bool igb_clean_tx_irq(struct igb_q_vector *q_vector)
 		 */
 		smp_mb();
 #ifdef	__APPLE__
-		if (netif_queue_stopped(netdev_ring(tx_ring)) &&
-			!(test_bit(__IGB_DOWN, &adapter->state))) {
-			netif_wake_queue(netdev_ring(tx_ring));
+		if (tx_ring->tx_stopped &&
+			!(test_bit(__IGB_DOWN, &adapter->state)) &&
+			netdev_ring(tx_ring)->wakeTxRing(tx_ring)) {
+			u64_stats_update_begin(&tx_ring->tx_syncp);
 			tx_ring->tx_stats.restart_queue++;
+			u64_stats_update_end(&tx_ring->tx_syncp);
 		}
 #else
 		if (netif_is_multiqueue(netdev_ring(tx_ring))) {
@@ -6466,7 +7529,13 @@ static void igb_receive_skb(struct igb_q_vector *q_vector,
                             struct sk_buff *skb)
 {
 #ifdef	__APPLE__
-	q_vector->adapter->netdev->receive(skb);
+	/* queued here, igb_clean_rx_irq hands the poll's frames up at once */
+	if (q_vector->rx_batch_tail)
+		mbuf_setnextpkt(q_vector->rx_batch_tail, skb);
+	else
+		q_vector->rx_batch = skb;
+	q_vector->rx_batch_tail = skb;
+	q_vector->rx_batch_len++;
 #else
 	struct vlan_group **vlgrp = netdev_priv(skb->dev);
 
@@ -6483,6 +7552,50 @@ static void igb_receive_skb(struct igb_q_vector *q_vector,
 #endif
 }
 
+#ifdef __APPLE__
+/**
+ * igb_loan_rx_page - hand a receive page to the stack without copying
+ * @rx_ring: rx descriptor ring the buffer belongs to
+ * @rx_buffer: buffer holding a frame or one fragment of it
+ * @rx_desc: descriptor containing length of buffer written by hardware
+ *
+ * Wraps the DMA buffer in an mbuf using external storage.  The buffer
+ * returns to the ring's pool once the stack frees the mbuf and the
+ * descriptor is refilled from the pool.  Returns NULL when the data should
+ * be copied instead, either because it is small or because no mbuf was
+ * available.
+ **/
+static mbuf_t igb_loan_rx_page(struct igb_ring *rx_ring,
+                               struct igb_rx_buffer *rx_buffer,
+                               union e1000_adv_rx_desc *rx_desc)
+{
+    unsigned int size = le16_to_cpu(rx_desc->wb.upper.length);
+    mbuf_t skb = NULL;
+    caddr_t va;
+
+    /* small frames are cheaper to copy than to give away a page for */
+    if (size <= IGB_RX_HDR_LEN)
+        return NULL;
+
+    va = (caddr_t)rx_buffer->page->va + rx_buffer->page_offset;
+    if (mbuf_attachcluster(MBUF_DONTWAIT, MBUF_TYPE_DATA, &skb, va,
+                           igb_rx_slot_free, IGB_RX_BUFSZ,
+                           (caddr_t)rx_buffer->page) != 0)
+        return NULL;
+
+    /* the pool must outlive the ring while the stack holds the buffer */
+    OSIncrementAtomic(&rx_buffer->page->pool->refcnt);
+
+    mbuf_setlen(skb, size);
+    mbuf_pkthdr_setlen(skb, size);
+    u64_stats_update_begin(&rx_ring->rx_syncp);
+    rx_ring->rx_stats.loaned++;
+    u64_stats_update_end(&rx_ring->rx_syncp);
+
+    return skb;
+}
+#endif /* __APPLE__ */
+
 /**
  * igb_reuse_rx_page - page flip buffer and store it back on the ring
  * @rx_ring: rx descriptor ring to store buffers on
@@ -6545,6 +7658,29 @@ static bool igb_can_reuse_rx_page(struct igb_rx_buffer *rx_buffer,
 }
 #endif //__APPLE__
 
+#ifdef __APPLE__
+/**
+ * igb_rx_chain - link a loaned fragment behind the frame being assembled
+ * @rx_ring: ring whose skb_tail marks the end of @skb
+ * @skb: first mbuf of the frame
+ * @frag: mbuf from igb_loan_rx_page
+ *
+ * Multi-descriptor (jumbo) frames grow one fragment per descriptor, so
+ * this and igb_add_rx_frag append at skb_tail instead of at
+ * mbuf_pkthdr_len, which would walk the chain every time.
+ **/
+static void igb_rx_chain(struct igb_ring *rx_ring, mbuf_t skb, mbuf_t frag)
+{
+    size_t size = mbuf_len(frag);
+
+    /* only the head of a chain carries a packet header */
+    mbuf_setflags_mask(frag, 0, MBUF_PKTHDR);
+    mbuf_setnext(rx_ring->skb_tail, frag);
+    rx_ring->skb_tail = frag;
+    mbuf_pkthdr_adjustlen(skb, size);
+}
+#endif /* __APPLE__ */
+
 /**
  * igb_add_rx_frag - Add contents of Rx buffer to sk_buff
  * @rx_ring: rx descriptor ring to transact packets on
@@ -6566,10 +7702,12 @@ static bool igb_add_rx_frag(struct igb_ring *rx_ring,
                             struct sk_buff *skb)
 {
 #ifdef __APPLE__
-    IOBufferMemoryDescriptor *page = rx_buffer->page;
+    struct igb_rx_slot *page = rx_buffer->page;
     unsigned int size = le16_to_cpu(rx_desc->wb.upper.length);
+    mbuf_t tail = rx_ring->skb_tail;
+    mbuf_t frag = NULL;
 
-    unsigned char *va = (u8*)page->getBytesNoCopy() + rx_buffer->page_offset;
+    unsigned char *va = page->va + rx_buffer->page_offset;
         
 #ifdef HAVE_PTP_1588_CLOCK
         if (igb_test_staterr(rx_desc, E1000_RXDADV_STAT_TSIP)) {
@@ -6579,9 +7717,31 @@ static bool igb_add_rx_frag(struct igb_ring *rx_ring,
         }
 #endif /* HAVE_PTP_1588_CLOCK */
         
-    mbuf_copyback(skb, mbuf_pkthdr_len(skb), size,
-                      va,
-                      MBUF_WAITOK);
+    if (rx_ring->skb_failed)
+        return true;
+
+    /*
+     * fill the tail mbuf, then a fresh cluster; the chain is never walked.
+     * Without a cluster the frame is dropped by igb_cleanup_headers.
+     */
+    if (mbuf_trailingspace(tail) < size) {
+        if (mbuf_getcluster(MBUF_DONTWAIT, MBUF_TYPE_DATA, MCLBYTES,
+                            &frag) != 0) {
+            rx_ring->skb_failed = true;
+            u64_stats_update_begin(&rx_ring->rx_syncp);
+            rx_ring->rx_stats.alloc_failed++;
+            u64_stats_update_end(&rx_ring->rx_syncp);
+            return true;
+        }
+        mbuf_setnext(tail, frag);
+        rx_ring->skb_tail = tail = frag;
+    }
+    memcpy((u8 *)mbuf_data(tail) + mbuf_len(tail), va, size);
+    mbuf_setlen(tail, mbuf_len(tail) + size);
+    mbuf_pkthdr_adjustlen(skb, size);
+    u64_stats_update_begin(&rx_ring->rx_syncp);
+    rx_ring->rx_stats.copied_bytes += size;
+    u64_stats_update_end(&rx_ring->rx_syncp);
     return true;
 #else //__APPLE__
     struct page *page = rx_buffer->page;
@@ -6638,13 +7798,92 @@ add_tail_frag:
 #endif // __APPLE__
 }
 
+#ifdef	__APPLE__
+/**
+ * igb_fetch_rx_split - assemble a frame from header split descriptors
+ * @rx_ring: rx descriptor ring the frame arrived on
+ * @rx_desc: descriptor written back by hardware
+ * @skb: frame being assembled, NULL on its first descriptor
+ *
+ * The first descriptor of a frame leaves up to IGB_RX_HDR_LEN bytes of
+ * headers in the ring's header buffer, which are copied into a small mbuf
+ * while still cache hot.  The payload in each descriptor's slot is loaned
+ * behind that mbuf when RxZeroCopy is on, and is copied otherwise, so the
+ * frame reaching the stack is byte for byte what igb_fetch_rx_buffer
+ * would have built.  A first descriptor with HBO set never gets here,
+ * igb_fetch_rx_buffer starts that frame from the slot.  LRO merges such
+ * a frame by freeing the header mbuf and linking the payload behind the
+ * flow, see igb_lro_payload.
+ **/
+static struct sk_buff *igb_fetch_rx_split(struct igb_ring *rx_ring,
+                                          union e1000_adv_rx_desc *rx_desc,
+                                          struct sk_buff *skb)
+{
+    u16 ntc = rx_ring->next_to_clean;
+    struct igb_rx_buffer *rx_buffer = &rx_ring->rx_buffer_info[ntc];
+    unsigned int size = le16_to_cpu(rx_desc->wb.upper.length);
+    mbuf_t payload;
+
+    if (likely(!skb)) {
+        u16 hdr_info = le16_to_cpu(rx_desc->wb.lower.lo_dword.hs_rss.hdr_info);
+        unsigned int hlen = (hdr_info & E1000_RXDADV_HDRBUFLEN_MASK) >>
+                            E1000_RXDADV_HDRBUFLEN_SHIFT;
+
+        if (hlen > IGB_RX_HDR_LEN)
+            hlen = IGB_RX_HDR_LEN;
+
+        skb = netdev_alloc_skb_ip_align(rx_ring->netdev, IGB_RX_HDR_LEN);
+        if (unlikely(!skb)) {
+            u64_stats_update_begin(&rx_ring->rx_syncp);
+            rx_ring->rx_stats.alloc_failed++;
+            u64_stats_update_end(&rx_ring->rx_syncp);
+            return NULL;
+        }
+        memcpy(mbuf_data(skb), IGB_RX_HDR(rx_ring, ntc), hlen);
+        mbuf_setlen(skb, hlen);
+        mbuf_pkthdr_setlen(skb, hlen);
+        rx_ring->skb_tail = skb;
+
+        if (hdr_info & E1000_RXDADV_SPH) {
+            u64_stats_update_begin(&rx_ring->rx_syncp);
+            rx_ring->rx_stats.hdr_split++;
+            u64_stats_update_end(&rx_ring->rx_syncp);
+        }
+    }
+
+    /* the whole frame fit in the header buffer, the slot stays on the ring */
+    if (!size) {
+        igb_reuse_rx_page(rx_ring, rx_buffer);
+        rx_buffer->page = NULL;
+        return skb;
+    }
+
+    if (rx_ring->netdev->rxZeroCopy()) {
+        payload = igb_loan_rx_page(rx_ring, rx_buffer, rx_desc);
+        if (payload) {
+            igb_rx_chain(rx_ring, skb, payload);
+
+            /* the ring refills this slot from the page cache */
+            rx_buffer->page = NULL;
+            return skb;
+        }
+    }
+
+    igb_add_rx_frag(rx_ring, rx_buffer, rx_desc, skb);
+    igb_reuse_rx_page(rx_ring, rx_buffer);
+    rx_buffer->page = NULL;
+
+    return skb;
+}
+#endif
+
 static struct sk_buff *igb_fetch_rx_buffer(struct igb_ring *rx_ring,
                                            union e1000_adv_rx_desc *rx_desc,
                                            struct sk_buff *skb)
 {
     struct igb_rx_buffer *rx_buffer;
 #ifdef	__APPLE__
-    IOBufferMemoryDescriptor *page;
+    struct igb_rx_slot *page;
 #else
     struct page *page;
 #endif
@@ -6654,6 +7893,30 @@ static struct sk_buff *igb_fetch_rx_buffer(struct igb_ring *rx_ring,
     page = rx_buffer->page;
     prefetchw(page);
 
+#ifdef	__APPLE__
+    /* headers longer than the header buffer overflow into the slot, so
+     * such a frame starts like one without header split */
+    if (rx_ring->hdr_va &&
+        (skb || !igb_test_staterr(rx_desc, E1000_RXDADV_ERR_HBO)))
+        return igb_fetch_rx_split(rx_ring, rx_desc, skb);
+
+    /* fragments go up in the page they landed in, jumbo ones as a chain */
+    if (rx_ring->netdev->rxZeroCopy()) {
+        mbuf_t frag = igb_loan_rx_page(rx_ring, rx_buffer, rx_desc);
+
+        if (frag) {
+            /* the ring refills this slot from the page cache */
+            rx_buffer->page = NULL;
+            if (likely(!skb)) {
+                rx_ring->skb_tail = frag;
+                return frag;
+            }
+            igb_rx_chain(rx_ring, skb, frag);
+            return skb;
+        }
+    }
+#endif
+
     if (likely(!skb)) {
 #ifndef	__APPLE__
         void *page_addr = page_address(page) +
@@ -6669,9 +7932,14 @@ static struct sk_buff *igb_fetch_rx_buffer(struct igb_ring *rx_ring,
         skb = netdev_alloc_skb_ip_align(rx_ring->netdev,
                                         IGB_RX_HDR_LEN);
         if (unlikely(!skb)) {
+            u64_stats_update_begin(&rx_ring->rx_syncp);
             rx_ring->rx_stats.alloc_failed++;
+            u64_stats_update_end(&rx_ring->rx_syncp);
             return NULL;
         }
+#ifdef	__APPLE__
+        rx_ring->skb_tail = skb;
+#endif
         /*
          * we will be copying header into skb->data in
          * pskb_may_pull so it is in our interest to prefetch
@@ -6737,8 +8005,11 @@ static inline void igb_rx_checksum(struct igb_ring *ring,
 		 * packets, (aka let the stack check the crc32c)
 		 */
 		if (!((mbuf_pkthdr_len(skb) == 60) &&
-		      test_bit(IGB_RING_FLAG_RX_SCTP_CSUM, &ring->flags)))
+		      test_bit(IGB_RING_FLAG_RX_SCTP_CSUM, &ring->flags))) {
+			u64_stats_update_begin(&ring->rx_syncp);
 			ring->rx_stats.csum_err++;
+			u64_stats_update_end(&ring->rx_syncp);
+		}
 
 		/* let the stack verify checksum errors */
 		return;
@@ -7004,6 +8275,12 @@ static bool igb_cleanup_headers(struct igb_ring *rx_ring,
 								struct sk_buff *skb)
 {
 #ifdef __APPLE__
+	if (unlikely(rx_ring->skb_failed)) {
+		/* counted as alloc_failed when the fragment was lost */
+		rx_ring->skb_failed = false;
+		rx_ring->netdev->freePacket(skb);
+		return true;
+	}
 	if (unlikely((igb_test_staterr(rx_desc,
 								   E1000_RXDEXT_ERR_FRAME_ERR_MASK)))) {
         AppleIGB* netdev = (AppleIGB*)rx_ring->netdev;
@@ -7034,6 +8311,401 @@ static bool igb_cleanup_headers(struct igb_ring *rx_ring,
 	return false;
 }
 
+#ifndef IGB_NO_LRO
+/* header checksum of an IPv4 header of ihl 32 bit words */
+static inline u16 ip_fast_csum(const void *iph, unsigned int ihl)
+{
+	const u16 *w = (const u16 *)iph;
+	u32 sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < ihl * 2; i++)
+		sum += w[i];
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum += sum >> 16;
+
+	return (u16)~sum;
+}
+
+/**
+ *  igb_can_lro - returns true if packet is TCP/IPV4 and LRO is enabled
+ *  @rx_ring: structure containing ring specific data
+ *  @rx_desc: pointer to the rx descriptor
+ *  @skb: pointer to the skb to be merged
+ *
+ **/
+static inline bool igb_can_lro(struct igb_ring *rx_ring,
+			       union e1000_adv_rx_desc *rx_desc,
+			       struct sk_buff *skb)
+{
+	AppleIGB *netdev = rx_ring->netdev;
+	struct ether_header *eh = (struct ether_header *)mbuf_data(skb);
+	struct iphdr *iph = (struct iphdr *)(eh + 1);
+	__le16 pkt_info = rx_desc->wb.lower.lo_dword.hs_rss.pkt_info;
+
+	/* verify hardware indicates this is IPv4/TCP */
+	if (!(pkt_info & cpu_to_le16(E1000_RXDADV_PKTTYPE_TCP)) ||
+	    !(pkt_info & cpu_to_le16(E1000_RXDADV_PKTTYPE_IPV4)))
+		return false;
+
+	/* .. and LRO is enabled */
+	if (!(netdev->features() & NETIF_F_LRO))
+		return false;
+
+	/* .. and we are not in promiscuous mode */
+	if (netdev->flags() & IFF_PROMISC)
+		return false;
+
+	/* .. and the hardware verified both checksums, merging voids them */
+	if (!(netdev->features() & NETIF_F_RXCSUM) ||
+	    igb_test_staterr(rx_desc, E1000_RXD_STAT_IXSM |
+			     E1000_RXDEXT_STATERR_TCPE |
+			     E1000_RXDEXT_STATERR_IPE) ||
+	    !igb_test_staterr(rx_desc, E1000_RXD_STAT_IPCS) ||
+	    !igb_test_staterr(rx_desc, E1000_RXD_STAT_TCPCS))
+		return false;
+
+	/* .. and the header is large enough for us to read IP/TCP fields */
+	if (mbuf_len(skb) < ETH_HLEN + sizeof(struct igb_lrohdr))
+		return false;
+
+	/* .. and there are no VLANs on packet */
+	if (eh->ether_type != htons(ETHERTYPE_IP))
+		return false;
+
+	/* .. and we are version 4 with no options */
+	if (*(u8 *)iph != 0x45)
+		return false;
+
+	/* .. and the packet is not fragmented */
+	if (iph->ip_off & htons(IP_MF | IP_OFFMASK))
+		return false;
+
+	/* .. and that next header is TCP */
+	if (iph->ip_p != IPPROTO_TCP)
+		return false;
+
+	return true;
+}
+
+static inline struct igb_lrohdr *igb_lro_hdr(struct sk_buff *skb)
+{
+	return (struct igb_lrohdr *)((u8 *)mbuf_data(skb) + ETH_HLEN);
+}
+
+/**
+ *  igb_lro_finish - Indicate a coalesced chain to upper layer.
+ *  @q_vector: structure containing interrupt and ring information
+ *  @flow: table entry holding the chain, left for the caller to drop
+ *
+ *  Rewrites the IP and TCP headers of the head frame to describe the
+ *  whole chain before handing it to the stack.
+ **/
+static void igb_lro_finish(struct igb_q_vector *q_vector,
+			   struct igb_lro_flow *flow)
+{
+	struct sk_buff *skb = flow->head;
+
+	if (flow->append_cnt) {
+		struct igb_lrohdr *lroh = igb_lro_hdr(skb);
+
+		/* incorporate ip header and re-calculate checksum */
+		lroh->iph.ip_len = htons(mbuf_pkthdr_len(skb) - ETH_HLEN);
+		lroh->iph.ip_sum = 0;
+
+		/* header length is 5 since we know no options exist */
+		lroh->iph.ip_sum = ip_fast_csum(&lroh->iph, 5);
+
+		/* clear TCP checksum to indicate we are an LRO frame */
+		lroh->th.th_sum = 0;
+
+		/* incorporate latest timestamp into the tcp header */
+		if (flow->tsecr) {
+			lroh->ts[2] = flow->tsecr;
+			lroh->ts[1] = htonl(flow->tsval);
+		}
+	}
+
+	igb_receive_skb(q_vector, skb);
+	q_vector->lrolist.stats.flushed++;
+}
+
+/**
+ *  igb_lro_flush - Indicate packets to upper layer.
+ *  @q_vector: structure containing interrupt and ring information
+ *  @flow: table entry to flush, invalid once this returns
+ **/
+static void igb_lro_flush(struct igb_q_vector *q_vector,
+			  struct igb_lro_flow *flow)
+{
+	struct igb_lro_list *lrolist = &q_vector->lrolist;
+	struct igb_lro_flow *last = &lrolist->flows[lrolist->count - 1];
+
+	igb_lro_finish(q_vector, flow);
+
+	/* keep the table oldest first */
+	memmove(flow, flow + 1, (char *)last - (char *)flow);
+	lrolist->count--;
+}
+
+static void igb_lro_flush_all(struct igb_q_vector *q_vector)
+{
+	struct igb_lro_list *lrolist = &q_vector->lrolist;
+	int i;
+
+	for (i = 0; i < lrolist->count; i++)
+		igb_lro_finish(q_vector, &lrolist->flows[i]);
+	lrolist->count = 0;
+}
+
+/**
+ *  igb_lro_header_ok - Main LRO function.
+ *  @skb: pointer to current skb being checked
+ *  @flow: filled in with the flow key and state of @skb
+ *
+ *  flow->mss is left 0 when @skb cannot be merged.
+ **/
+static void igb_lro_header_ok(struct sk_buff *skb, struct igb_lro_flow *flow)
+{
+	struct igb_lrohdr *lroh = igb_lro_hdr(skb);
+	u16 opt_bytes, data_len;
+	size_t frame_len;
+
+	flow->head = skb;
+	flow->tail = skb;
+	flow->saddr = lroh->iph.ip_src.s_addr;
+	flow->daddr = lroh->iph.ip_dst.s_addr;
+	flow->ports = *(__be32 *)&lroh->th;
+	flow->ack_seq = lroh->th.th_ack;
+	flow->window = lroh->th.th_win;
+	flow->next_seq = ntohl(lroh->th.th_seq);
+	flow->tsecr = 0;
+	flow->tsval = 0;
+	flow->free = 0;
+	flow->mss = 0;
+	flow->append_cnt = 0;
+	if (mbuf_get_vlan_tag(skb, &flow->vid) != 0)
+		flow->vid = 0;
+
+	/* If we see CE codepoint in IP header, packet is not mergeable */
+	if ((lroh->iph.ip_tos & IPTOS_ECN_MASK) == IPTOS_ECN_CE)
+		return;
+
+	/* ensure no bits set besides ack or psh */
+	if ((lroh->th.th_flags & ~(TH_ACK | TH_PUSH)) ||
+	    !(lroh->th.th_flags & TH_ACK))
+		return;
+
+	/* store the total packet length */
+	data_len = ntohs(lroh->iph.ip_len);
+	frame_len = mbuf_pkthdr_len(skb);
+	if (data_len < sizeof(struct igb_lrohdr) ||
+	    ETH_HLEN + data_len > frame_len)
+		return;
+
+	/* remove any padding from the end of the skb */
+	if (ETH_HLEN + data_len < frame_len)
+		mbuf_adj(skb, -(int)(frame_len - ETH_HLEN - data_len));
+
+	/* remove header length from data length */
+	data_len -= sizeof(struct igb_lrohdr);
+
+	/*
+	 * check for timestamps. Since the only option we handle are timestamps,
+	 * we only have to handle the simple case of aligned timestamps
+	 */
+	opt_bytes = (lroh->th.th_off << 2) - sizeof(struct tcphdr);
+	if (opt_bytes != 0) {
+		if ((opt_bytes != TCPOLEN_TSTAMP_APPA) ||
+		    (data_len < TCPOLEN_TSTAMP_APPA) ||
+		    (mbuf_len(skb) < ETH_HLEN + sizeof(struct igb_lrohdr) +
+				     TCPOLEN_TSTAMP_APPA) ||
+		    (lroh->ts[0] != htonl(TCPOPT_TSTAMP_HDR)) ||
+		    (lroh->ts[2] == 0))
+			return;
+
+		flow->tsval = ntohl(lroh->ts[1]);
+		flow->tsecr = lroh->ts[2];
+
+		data_len -= TCPOLEN_TSTAMP_APPA;
+	}
+
+	/* record data_len as mss for the packet */
+	flow->mss = data_len;
+}
+
+/**
+ *  igb_lro_payload - strip the headers off a frame about to be merged
+ *  @new_skb: frame whose first mbuf holds all of its headers
+ *  @hdr_len: bytes of Ethernet, IP and TCP header to drop
+ *
+ *  Returns the payload as a chain without a packet header, or NULL with
+ *  @new_skb untouched if that can not be done.  A first mbuf holding
+ *  nothing but headers, as a header split frame's does, is freed.  The
+ *  packet header flag can only be cleared on a cluster mbuf, so payload
+ *  left in a small first mbuf is copied into a fresh one.
+ **/
+static mbuf_t igb_lro_payload(struct sk_buff *new_skb, size_t hdr_len)
+{
+	size_t rest = mbuf_len(new_skb) - hdr_len;
+	mbuf_t payload = mbuf_next(new_skb);
+	mbuf_t copy;
+
+	if (!rest && !payload)
+		return NULL;
+	if (rest) {
+		if (mbuf_flags(new_skb) & MBUF_EXT) {
+			if (mbuf_setflags_mask(new_skb, 0, MBUF_PKTHDR) != 0)
+				return NULL;
+			mbuf_adj(new_skb, (int)hdr_len);
+			return new_skb;
+		}
+		if (mbuf_get(MBUF_DONTWAIT, MBUF_TYPE_DATA, &copy) != 0)
+			return NULL;
+		memcpy(mbuf_data(copy), (u8 *)mbuf_data(new_skb) + hdr_len, rest);
+		mbuf_setlen(copy, rest);
+		mbuf_setnext(copy, payload);
+		payload = copy;
+	}
+	mbuf_setnext(new_skb, NULL);
+	mbuf_freem(new_skb);
+	return payload;
+}
+
+/**
+ *  igb_lro_receive - if able, queue skb into lro chain
+ *  @q_vector: structure containing interrupt and ring information
+ *  @new_skb: pointer to current skb being checked
+ *  @tail: last mbuf of @new_skb, the ring's skb_tail
+ *
+ *  Checks whether the skb given is eligible for LRO and if that's
+ *  fine chains its payload behind the tail of the matching flow.  If
+ *  the flow is not in the table yet it is added, evicting the oldest
+ *  flow once IGB_LRO_MAX are held.
+ **/
+static void igb_lro_receive(struct igb_q_vector *q_vector,
+			    struct sk_buff *new_skb, mbuf_t tail)
+{
+	struct igb_lro_list *lrolist = &q_vector->lrolist;
+	struct igb_lro_flow new_flow, *flow;
+	bool psh = igb_lro_hdr(new_skb)->th.th_flags & TH_PUSH;
+	size_t hdr_len;
+	mbuf_t payload;
+	u16 data_len;
+	int i;
+
+	igb_lro_header_ok(new_skb, &new_flow);
+
+	/*
+	 * we have a packet that might be eligible for LRO,
+	 * so see if it matches anything we might expect
+	 */
+	for (i = 0; i < lrolist->count; i++) {
+		flow = &lrolist->flows[i];
+		if (flow->ports != new_flow.ports ||
+		    flow->saddr != new_flow.saddr ||
+		    flow->daddr != new_flow.daddr ||
+		    flow->vid != new_flow.vid)
+			continue;
+
+		/* out of order packet */
+		if (flow->next_seq != new_flow.next_seq) {
+			igb_lro_flush(q_vector, flow);
+			new_flow.mss = 0;
+			break;
+		}
+
+		/* TCP timestamp options have changed */
+		if (!flow->tsecr != !new_flow.tsecr) {
+			igb_lro_flush(q_vector, flow);
+			break;
+		}
+
+		/* make sure timestamp values are increasing */
+		if (flow->tsecr && (s32)(new_flow.tsval - flow->tsval) < 0) {
+			igb_lro_flush(q_vector, flow);
+			new_flow.mss = 0;
+			break;
+		}
+
+		data_len = new_flow.mss;
+
+		/* Malicious packet */
+		if (data_len == 0 ||
+		    data_len > flow->mss ||
+		    data_len > flow->free) {
+			igb_lro_flush(q_vector, flow);
+			break;
+		}
+
+		/* ack sequence numbers or window size has changed */
+		if (flow->ack_seq != new_flow.ack_seq ||
+		    flow->window != new_flow.window) {
+			igb_lro_flush(q_vector, flow);
+			break;
+		}
+
+		/* Remove IP and TCP header, only the head keeps a pkthdr */
+		hdr_len = mbuf_pkthdr_len(new_skb) - data_len;
+		payload = NULL;
+		if (mbuf_len(new_skb) >= hdr_len)
+			payload = igb_lro_payload(new_skb, hdr_len);
+		if (!payload) {
+			igb_lro_flush(q_vector, flow);
+			break;
+		}
+
+		/* link it behind the tail, no need to walk the chain */
+		mbuf_setnext(flow->tail, payload);
+		if (payload != new_skb && !mbuf_next(payload))
+			flow->tail = payload;	/* a lone copy ends the chain */
+		else
+			flow->tail = tail;
+		mbuf_pkthdr_adjustlen(flow->head, data_len);
+
+		/* update timestamp and timestamp echo response */
+		flow->tsval = new_flow.tsval;
+		flow->tsecr = new_flow.tsecr;
+
+		/* update sequence and free space */
+		flow->next_seq += data_len;
+		flow->free -= data_len;
+
+		/* update append_cnt */
+		flow->append_cnt++;
+
+		lrolist->stats.coal++;
+
+		/* if we are at the end of the fragment list flush */
+		if (psh || flow->free < flow->mss) {
+			if (psh)
+				igb_lro_hdr(flow->head)->th.th_flags |= TH_PUSH;
+			igb_lro_flush(q_vector, flow);
+		}
+		return;
+	}
+
+	if (new_flow.mss && !psh) {
+		/* if we are at capacity flush the oldest flow */
+		if (lrolist->count >= IGB_LRO_MAX)
+			igb_lro_flush(q_vector, &lrolist->flows[0]);
+
+		/* update sequence and free space */
+		new_flow.next_seq += new_flow.mss;
+		new_flow.free = 65521 - (mbuf_pkthdr_len(new_skb) - ETH_HLEN);
+		new_flow.tail = tail;
+
+		/* .. and append to the table */
+		lrolist->flows[lrolist->count++] = new_flow;
+		lrolist->stats.coal++;
+		return;
+	}
+
+	/* packet not handled by any of the above, pass it to the stack */
+	igb_receive_skb(q_vector, new_skb);
+}
+
+#endif /* IGB_NO_LRO */
 /* igb_clean_rx_irq -- * packet split */
 static bool igb_clean_rx_irq(struct igb_q_vector *q_vector, int budget)
 {
@@ -7094,7 +8766,7 @@ static bool igb_clean_rx_irq(struct igb_q_vector *q_vector, int budget)
 		
 #ifndef IGB_NO_LRO
 		if (igb_can_lro(rx_ring, rx_desc, skb))
-			igb_lro_receive(q_vector, skb);
+			igb_lro_receive(q_vector, skb, rx_ring->skb_tail);
 		else
 #endif
 #ifdef HAVE_VLAN_RX_REGISTER
@@ -7117,8 +8789,10 @@ static bool igb_clean_rx_irq(struct igb_q_vector *q_vector, int budget)
 	/* place incomplete frames back on ring for completion */
 	rx_ring->skb = skb;
 	
+	u64_stats_update_begin(&rx_ring->rx_syncp);
 	rx_ring->rx_stats.packets += total_packets;
 	rx_ring->rx_stats.bytes += total_bytes;
+	u64_stats_update_end(&rx_ring->rx_syncp);
 	q_vector->rx.total_packets += total_packets;
 	q_vector->rx.total_bytes += total_bytes;
 	
@@ -7129,6 +8803,16 @@ static bool igb_clean_rx_irq(struct igb_q_vector *q_vector, int budget)
 	igb_lro_flush_all(q_vector);
 	
 #endif /* IGB_NO_LRO */
+#ifdef __APPLE__
+	if (q_vector->rx_batch) {
+		q_vector->adapter->netdev->receive(q_vector->rx_batch,
+						   q_vector->rx_batch_tail,
+						   q_vector->rx_batch_len);
+		q_vector->rx_batch = NULL;
+		q_vector->rx_batch_tail = NULL;
+		q_vector->rx_batch_len = 0;
+	}
+#endif
 	return (total_packets < budget);
 }
 
@@ -7144,19 +8828,15 @@ static bool igb_alloc_mapped_page(struct igb_ring *rx_ring,
 	if (likely(bi->page))
 		return true;
 
-	/* alloc new page for storage */
-	bi->page = 	IOBufferMemoryDescriptor::inTaskWithOptions( kernel_task,
-                            kIODirectionInOut | kIOMemoryPhysicallyContiguous,
-                            PAGE_SIZE, PAGE_SIZE );
-
+	/* take a pre-mapped slot from the ring's pool */
+	bi->page = igb_rx_pool_get(rx_ring);
 	if (unlikely(!bi->page)) {
+		u64_stats_update_begin(&rx_ring->rx_syncp);
 		rx_ring->rx_stats.alloc_failed++;
+		u64_stats_update_end(&rx_ring->rx_syncp);
 		return false;
 	}
-
-	/* map page for use */
-    bi->page->prepare();
-    dma = bi->page->getPhysicalAddress();
+	dma = bi->page->dma;
 
 	bi->dma = dma;
 #else
@@ -7225,6 +8905,11 @@ void igb_alloc_rx_buffers(struct igb_ring *rx_ring, u16 cleaned_count)
 		 * because each write-back erases this info.
 		 */
 		rx_desc->read.pkt_addr = cpu_to_le64(bi->dma + bi->page_offset);
+#ifdef __APPLE__
+		if (rx_ring->hdr_va)
+			rx_desc->read.hdr_addr = cpu_to_le64(IGB_RX_HDR_DMA(rx_ring,
+						bi - rx_ring->rx_buffer_info));
+#endif
 		rx_desc++;
 		bi++;
 		i++;
@@ -7444,111 +9129,11 @@ void igb_vlan_mode(IOEthernetController *netdev, u32 features)
 	igb_rlpml_set(adapter);
 }
 
-#ifdef HAVE_INT_NDO_VLAN_RX_ADD_VID
-#ifdef NETIF_F_HW_VLAN_CTAG_RX
-static int igb_vlan_rx_add_vid(struct net_device *netdev,
-									   __always_unused __be16 proto, u16 vid)
-#else
-static int igb_vlan_rx_add_vid(IOEthernetController *netdev, u16 vid)
-#endif
-#else
-static void igb_vlan_rx_add_vid(IOEthernetController *netdev, u16 vid)
-#endif
+static void igb_restore_vlan(struct igb_adapter *adapter)
 {
-	struct igb_adapter *adapter = netdev_priv(netdev);
-	int pf_id = adapter->vfs_allocated_count;
-
-	/* attempt to add filter to vlvf array */
-	igb_vlvf_set(adapter, vid, TRUE, pf_id);
-
-	/* add the filter since PF can receive vlans w/o entry in vlvf */
-	igb_vfta_set(adapter, vid, TRUE);
-
-#ifndef HAVE_VLAN_RX_REGISTER
-
-	set_bit(vid, adapter->active_vlans);
-#endif
-#ifdef HAVE_INT_NDO_VLAN_RX_ADD_VID
-		return 0;
-#endif
-}
-
-#ifndef __APPLE__
-#ifdef HAVE_INT_NDO_VLAN_RX_ADD_VID
-#ifdef NETIF_F_HW_VLAN_CTAG_RX
-		static int igb_vlan_rx_kill_vid(struct net_device *netdev,
-										__always_unused __be16 proto, u16 vid)
-#else
-		static int igb_vlan_rx_kill_vid(struct net_device *netdev, u16 vid)
-#endif
-#else
-		static void igb_vlan_rx_kill_vid(struct net_device *netdev, u16 vid)
-#endif
-	{
-		struct igb_adapter *adapter = netdev_priv(netdev);
-		int pf_id = adapter->vfs_allocated_count;
-		s32 err;
-		
-#ifdef HAVE_VLAN_RX_REGISTER
-		igb_irq_disable(adapter);
-		
-		vlan_group_set_device(adapter->vlgrp, vid, NULL);
-		
-		if (!test_bit(__IGB_DOWN, &adapter->state))
-			igb_irq_enable(adapter);
-		
-#endif /* HAVE_VLAN_RX_REGISTER */
-		/* remove vlan from VLVF table array */
-		err = igb_vlvf_set(adapter, vid, FALSE, pf_id);
-		
-		/* if vid was not present in VLVF just remove it from table */
-		if (err)
-			igb_vfta_set(adapter, vid, FALSE);
-#ifndef HAVE_VLAN_RX_REGISTER
-		
-		clear_bit(vid, adapter->active_vlans);
-#endif
-#ifdef HAVE_INT_NDO_VLAN_RX_ADD_VID
-		return 0;
-#endif
-	}
-#endif
-
-static void igb_restore_vlan(struct igb_adapter *adapter)
-{
-#ifdef	__APPLE__
-	igb_vlan_mode(adapter->netdev, adapter->vlgrp);
-#else /* __APPLE__ */
-#ifdef HAVE_VLAN_RX_REGISTER
-	igb_vlan_mode(adapter->netdev, adapter->vlgrp);
-	
-	if (adapter->vlgrp) {
-		u16 vid;
-		for (vid = 0; vid < VLAN_N_VID; vid++) {
-			if (!vlan_group_get_device(adapter->vlgrp, vid))
-				continue;
-#ifdef NETIF_F_HW_VLAN_CTAG_RX
-			igb_vlan_rx_add_vid(adapter->netdev,
-								htons(ETH_P_8021Q), vid);
-#else
-			igb_vlan_rx_add_vid(adapter->netdev, vid);
-#endif
-		}
-	}
-#else
-	u16 vid;
-	
-	igb_vlan_mode(adapter->netdev, adapter->netdev->features);
-	
-	for_each_set_bit(vid, adapter->active_vlans, VLAN_N_VID)
-#ifdef NETIF_F_HW_VLAN_CTAG_RX
-	igb_vlan_rx_add_vid(adapter->netdev,
-						htons(ETH_P_8021Q), vid);
-#else
-	igb_vlan_rx_add_vid(adapter->netdev, vid);
-#endif
-#endif
-#endif  // __APPLE__
+	igb_vlan_mode(adapter->netdev, adapter->vlgrp);
+	/* e1000_init_hw clears the table, put the shadow back in one pass */
+	igb_vfta_write_all(adapter);
 }
 
 #ifndef	__APPLE__
@@ -8411,6 +9996,14 @@ OSDefineMetaClassAndStructors(AppleIGB, super);
 void AppleIGB::free()
 {
 	RELEASE(mediumDict);
+	if (rxInputLock) {
+		IOLockFree(rxInputLock);
+		rxInputLock = NULL;
+	}
+	if (rxPendingLock) {
+		IOSimpleLockFree(rxPendingLock);
+		rxPendingLock = NULL;
+	}
 	
 	super::free();
 }
@@ -8485,9 +10078,24 @@ bool AppleIGB::init(OSDictionary *properties)
 	mediumDict = NULL;
 	csrPCIAddress = NULL;
 	interruptSource = NULL;
+	for (int i = 0; i < MAX_Q_VECTORS + NON_Q_VECTORS; i++)
+		msixSources[i] = NULL;
+	for (int i = 0; i < MAX_Q_VECTORS; i++)
+		queueWorkLoops[i] = NULL;
+	numMsixSources = 0;
 	watchdogSource = NULL;
     resetSource = NULL;
     dmaErrSource = NULL;
+    txFlushSource = NULL;
+    txFlushArmed = false;
+    phySource = NULL;
+    phyState = kPhyIdle;
+    phyPolls = 0;
+    phyRestarts = 0;
+    phyRestartUp = false;
+    txBatchDepth = 1;
+    rxBatches = 0;
+    rxBatchPackets = 0;
 
 	netif = NULL;
 	
@@ -8497,12 +10105,24 @@ bool AppleIGB::init(OSDictionary *properties)
 	bSuspended = FALSE;
 
     linkUp = FALSE;
-    stalled = FALSE;
+    useRxZeroCopy = FALSE;
+    useRxHeaderSplit = FALSE;
 
     eeeMode = 0;
 
 	_mtu = 1500;
 
+	rxPendingLock = NULL;
+	rxInputLock = IOLockAlloc();
+	if (rxInputLock == NULL)
+		return false;
+	rxPendingLock = IOSimpleLockAlloc();
+	if (rxPendingLock == NULL)
+		return false;
+	rxPending = NULL;
+	rxPendingTail = NULL;
+	rxPendingCount = 0;
+
 	return true;
 }
 
@@ -8557,6 +10177,8 @@ void AppleIGB::igb_remove()
 #endif
 	kfree(adapter->mac_table, sizeof(struct igb_mac_addr)* adapter->hw.mac.rar_entry_count);
 	kfree(adapter->shadow_vfta, sizeof(u32) * E1000_VFTA_ENTRIES);
+	kfree(adapter->nvm_shadow, sizeof(u16) * adapter->nvm_shadow_words);
+	adapter->nvm_shadow = NULL;
 #if	1
 #else
 	free_netdev(netdev);
@@ -8588,11 +10210,16 @@ void AppleIGB::stop(IOService* provider)
 			workLoop->removeEventSource(dmaErrSource);
 			RELEASE(dmaErrSource);
 		}
-		
-		if (interruptSource) {
-			workLoop->removeEventSource(interruptSource);
-			RELEASE(interruptSource);
+		if (txFlushSource) {
+			workLoop->removeEventSource(txFlushSource);
+			RELEASE(txFlushSource);
 		}
+		if (phySource) {
+			workLoop->removeEventSource(phySource);
+			RELEASE(phySource);
+		}
+		
+		releaseInterruptSources();
 		RELEASE(workLoop);
 	}
 
@@ -8605,6 +10232,17 @@ void AppleIGB::stop(IOService* provider)
 	super::stop(provider);
 }
 
+
+/* Info.plist keys handed to igb_set_option, named after the module parameters */
+static const char *moduleOptions[] = {
+	"IntMode",
+	"RSS",
+	"ItrController",
+	"ItrTargetPackets",
+	"LLIPort",
+	"LLIPush",
+	"LLISize",
+};
 	
 // igb_probe
 bool AppleIGB::igb_probe()
@@ -8616,6 +10254,7 @@ bool AppleIGB::igb_probe()
 	u8 pba_str[E1000_PBANUM_LENGTH];
 	s32 ret_val;
 	int err;
+	u32 i;
 	static SInt8 global_quad_port_a; /* global quad port a indication */
 	static SInt8 cards_found;
 	
@@ -8693,8 +10332,6 @@ bool AppleIGB::igb_probe()
 		//netdev->tx_timeout = &igb_tx_timeout;
 #endif
 		//netdev->vlan_rx_register = igb_vlan_mode;
-		//netdev->vlan_rx_add_vid = igb_vlan_rx_add_vid;
-		//netdev->vlan_rx_kill_vid = igb_vlan_rx_kill_vid;
 		//netdev->hard_start_xmit = &igb_xmit_frame;
 #endif /* HAVE_NET_DEVICE_OPS */
 		//igb_set_ethtool_ops(netdev);
@@ -8706,8 +10343,18 @@ bool AppleIGB::igb_probe()
 		
 		adapter->bd_number = OSIncrementAtomic8(&cards_found);
 		
+		/* personality keys stand in for the Linux module parameters */
+		for (i = 0; i < sizeof(moduleOptions)/sizeof(moduleOptions[0]); i++) {
+			OSNumber *num = OSDynamicCast(OSNumber, getProperty(moduleOptions[i]));
+			if (num)
+				igb_set_option(adapter->bd_number, moduleOptions[i],
+							   num->unsigned32BitValue());
+		}
+		
 		/* setup the private structure */
+		igb_phase_begin(adapter, IGB_PHASE_SW_INIT);
 		err = igb_sw_init(adapter);
+		igb_phase_end(adapter, IGB_PHASE_SW_INIT);
 		if (err)
 			goto err_sw_init;
 		
@@ -8782,6 +10429,8 @@ bool AppleIGB::igb_probe()
 		e1000_reset_hw(hw);
 		
 		/* make sure the NVM is good */
+		igb_phase_begin(adapter, IGB_PHASE_NVM);
+		igb_nvm_shadow_fill(adapter);
 		if (e1000_validate_nvm_checksum(hw) < 0) {
 			pr_err("The NVM Checksum Is Not Valid\n");
 			goto err_eeprom;
@@ -8790,6 +10439,7 @@ bool AppleIGB::igb_probe()
 		/* copy the MAC address out of the NVM */
 		if (e1000_read_mac_addr(hw))
             pr_err("NVM Read Error\n");
+		igb_phase_end(adapter, IGB_PHASE_NVM);
 		
 		if (!is_valid_ether_addr(hw->mac.addr)) {
             pr_err("Invalid MAC Address\n");
@@ -9027,6 +10677,8 @@ bool AppleIGB::igb_probe()
 		
 	err_sw_init:
 		kfree(adapter->shadow_vfta,sizeof(u32) * E1000_VFTA_ENTRIES);
+		kfree(adapter->nvm_shadow, sizeof(u16) * adapter->nvm_shadow_words);
+		adapter->nvm_shadow = NULL;
 		igb_clear_interrupt_scheme(adapter);
 		igb_reset_sriov_capability(adapter);
 		RELEASE(csrPCIAddress);	// iounmap(hw->io_addr);
@@ -9059,6 +10711,81 @@ int AppleIGB::getIntOption(const char *name, int defVal, int maxVal, int minVal
 	return val;
 }
 		
+/**
+ * setLowLatencyInterrupts - change the LLI filters at runtime
+ * @dict: any of LLIPort, LLIPush and LLISize, as in the personality
+ *
+ * Runs behind the command gate.  The filters are written straight away
+ * if the interface is up and again by igb_open/igb_up after a reset.
+ **/
+IOReturn AppleIGB::setLowLatencyInterrupts(OSDictionary *dict)
+{
+	struct igb_adapter *adapter = &priv_adapter;
+	OSNumber *num;
+	bool changed = false;
+
+	num = OSDynamicCast(OSNumber, dict->getObject("LLIPort"));
+	if (num && num->unsigned32BitValue() <= 0xFFFF) {
+		adapter->lli_port = num->unsigned32BitValue();
+		setProperty("LLIPort", num);
+		changed = true;
+	}
+	num = OSDynamicCast(OSNumber, dict->getObject("LLIPush"));
+	if (num && num->unsigned32BitValue() <= 1) {
+		if (num->unsigned32BitValue())
+			adapter->flags |= IGB_FLAG_LLI_PUSH;
+		else
+			adapter->flags &= ~IGB_FLAG_LLI_PUSH;
+		setProperty("LLIPush", num);
+		changed = true;
+	}
+	num = OSDynamicCast(OSNumber, dict->getObject("LLISize"));
+	if (num && num->unsigned32BitValue() <= 1500) {
+		adapter->lli_size = num->unsigned32BitValue();
+		setProperty("LLISize", num);
+		changed = true;
+	}
+	if (!changed)
+		return kIOReturnUnsupported;
+
+	pr_debug("LLI port %u push %u size %u\n", adapter->lli_port,
+			 !!(adapter->flags & IGB_FLAG_LLI_PUSH), adapter->lli_size);
+	if (!test_bit(__IGB_DOWN, &adapter->state))
+		igb_configure_lli(adapter);
+	return kIOReturnSuccess;
+}
+
+IOReturn AppleIGB::setPropertiesGated(OSObject *owner, void *arg0, void *arg1, void *arg2, void *arg3)
+{
+	AppleIGB *me = (AppleIGB *) owner;
+	OSDictionary *dict = (OSDictionary *) arg0;
+	IOReturn ret = me->setLowLatencyInterrupts(dict);
+
+	/* fresh queue counters for a diagnostic tool, without waiting for
+	 * the watchdog; only reads the snapshots */
+	if (dict->getObject("RefreshQueueStats")) {
+		me->updateQueueStats();
+		ret = kIOReturnSuccess;
+	}
+	return ret;
+}
+
+IOReturn AppleIGB::setProperties(OSObject *properties)
+{
+	OSDictionary *dict = OSDynamicCast(OSDictionary, properties);
+	IOReturn ret;
+
+	if (!dict)
+		return super::setProperties(properties);
+	if (IOUserClient::clientHasPrivilege(current_task(), kIOClientPrivilegeAdministrator) != kIOReturnSuccess)
+		return kIOReturnNotPrivileged;
+	ret = getCommandGate()->runAction(setPropertiesGated, dict);
+	/* none of our keys, let the superclasses look at it */
+	if (ret == kIOReturnUnsupported)
+		ret = super::setProperties(properties);
+	return ret;
+}
+
 bool AppleIGB::start(IOService* provider)
 {
     u32 i;
@@ -9086,6 +10813,13 @@ bool AppleIGB::start(IOService* provider)
 #else
 	useTSO = FALSE;
 #endif
+	useRxZeroCopy = getBoolOption("RxZeroCopy", TRUE);
+	useRxHeaderSplit = getBoolOption("RxHeaderSplit", FALSE);
+	/* off by default like upstream, merged frames must not be forwarded */
+	if (getBoolOption("NETIF_F_LRO", FALSE))
+		_features |= NETIF_F_LRO;
+	txBatchDepth = getIntOption("TxDoorbellBatch", IGB_TX_BATCH_DEFAULT, IGB_DEFAULT_TXD / 4, 1);
+	busyPollUS = getIntOption("BusyPollUS", 0, IGB_BUSY_POLL_MAX_US, 0);
 
     /** igb_probe requires watchdog to be intialized*/
     if(!initEventSources(provider)) {
@@ -9093,10 +10827,17 @@ bool AppleIGB::start(IOService* provider)
         return false;
     }
 
+    igb_phase_begin(&priv_adapter, IGB_PHASE_PROBE);
     if(!igb_probe()) {
         pr_err("Failed to igb_probe()\n");
         return false;
     }
+    igb_phase_end(&priv_adapter, IGB_PHASE_PROBE);
+
+    if (!initInterruptSources()) {
+        pr_err("Failed to initInterruptSources()\n");
+        return false;
+    }
 
     if (!setupMediumDict()) {
         pr_err("Failed to setupMediumDict\n");
@@ -9120,6 +10861,7 @@ bool AppleIGB::start(IOService* provider)
     }
 
     netif->registerService();
+    publishBootPhases();
 
     return true;
 
@@ -9165,32 +10907,11 @@ bool AppleIGB::initEventSources( IOService* provider )
 	}
     transmitQueue->retain();
 
-#ifdef MSIX_ENABLED
-    while (pdev->getInterruptType(intrIndex, &intrType) == kIOReturnSuccess) {
-        if (intrType & kIOInterruptTypePCIMessaged){
-            msiIndex = intrIndex;
-            break;
-        }
-        intrIndex++;
-    }
-
-    if (msiIndex != -1) {
-        pr_err("MSI interrupt index: %d\n", msiIndex);
-        interruptSource = IOInterruptEventSource::interruptEventSource(this, OSMemberFunctionCast(IOInterruptEventSource::Action, this, &AppleIGB::interruptOccurred), provider, msiIndex);
-    }
-#endif
-
-    interruptSource = IOInterruptEventSource::interruptEventSource(this,&AppleIGB::interruptHandler,provider);
-    if (!interruptSource) {
-        pr_err("MSI interrupt could not be enabled.\n");
-        goto error1;
-    }
-    getWorkLoop()->addEventSource(interruptSource);
-
+	/* interrupt sources follow the scheme chosen in igb_probe */
 	watchdogSource = IOTimerEventSource::timerEventSource(this, &AppleIGB::watchdogHandler );
     if (!watchdogSource) {
         pr_err("Failed to create IOTimerEventSource.\n");
-        goto error2;
+        goto error1;
     }
 	getWorkLoop()->addEventSource(watchdogSource);
 
@@ -9200,15 +10921,17 @@ bool AppleIGB::initEventSources( IOService* provider )
 	dmaErrSource = IOTimerEventSource::timerEventSource(this, &AppleIGB::resetHandler );
 	getWorkLoop()->addEventSource(dmaErrSource);
 
+	txFlushSource = IOTimerEventSource::timerEventSource(this, &AppleIGB::txFlushHandler );
+	getWorkLoop()->addEventSource(txFlushSource);
+
+	phySource = IOTimerEventSource::timerEventSource(this, &AppleIGB::phyHandler );
+	getWorkLoop()->addEventSource(phySource);
+
     pr_debug("initEventSources() <===\n");
 	return true;
 done:
     return result;
 
-error2:
-    workLoop->removeEventSource(interruptSource);
-    RELEASE(interruptSource);
-
 error1:
     pr_err("Error initializing event sources.\n");
     transmitQueue->release();
@@ -9222,9 +10945,12 @@ IOReturn AppleIGB::enable(IONetworkInterface * netif)
     const IONetworkMedium *selectedMedium;
     struct e1000_hw *hw = &priv_adapter.hw;
     int ret_val;
+    u64 start = mach_absolute_time(), elapsed;
 	pr_err("enable() ===>\n");
 	if(!enabledForNetif){
 		pdev->open(this);
+        /* ends in setLinkUp */
+        igb_phase_begin(&priv_adapter, IGB_PHASE_LINK);
 
         selectedMedium = getSelectedMedium();
 
@@ -9238,18 +10964,18 @@ IOReturn AppleIGB::enable(IONetworkInterface * netif)
 
         intelSetupAdvForMedium(selectedMedium);
 
+        igb_phase_begin(&priv_adapter, IGB_PHASE_OPEN);
         ret_val = igb_open(this);
+        igb_phase_end(&priv_adapter, IGB_PHASE_OPEN);
         if (ret_val) {
             pr_err("igb_open failed %d\n", ret_val);
             return kIOReturnIOError;
         }
 
         // hack to accept any VLAN
-        for(u16 k = 1; k < 4096; k++){
-            igb_vlan_rx_add_vid(this,k);
-        }
+        igb_vlan_rx_add_all(&priv_adapter);
 
-        interruptSource->enable();
+        setInterruptSources(true);
         setTimers(true);
 
         if (!transmitQueue->setCapacity(IGB_DEFAULT_TXD)) {
@@ -9261,11 +10987,15 @@ IOReturn AppleIGB::enable(IONetworkInterface * netif)
         }
 
         eeeMode = 0;
-        stalled = FALSE;
 
         hw->mac.get_link_status = true;
 
 		enabledForNetif = true;
+
+        absolutetime_to_nanoseconds(mach_absolute_time() - start, &elapsed);
+        setProperty("EnableTimeUS", elapsed / NSEC_PER_USEC, 32);
+        pr_debug("enable() took %llu us\n", elapsed / NSEC_PER_USEC);
+        publishBootPhases();
     } else {
         pr_err("enabled already \n");
     }
@@ -9285,7 +11015,8 @@ IOReturn AppleIGB::disable(IONetworkInterface * netif)
         transmitQueue->setCapacity(0);
 
         watchdogSource->cancelTimeout();
-        interruptSource->disable();
+        phyRestartCancel();
+        setInterruptSources(false);
         setTimers(false);
 
 		igb_close(this);
@@ -9293,7 +11024,6 @@ IOReturn AppleIGB::disable(IONetworkInterface * netif)
         igb_irq_disable(&priv_adapter);
 
         eeeMode = 0;
-        stalled = FALSE;
 
         if (carrier()) {
             setCarrier(false);
@@ -9464,15 +11194,14 @@ void AppleIGB::setLinkUp()
 
     linkUp = true;
 
-    if (stalled) {
-        transmitQueue->service();
-        stalled = false;
-        pr_debug("Restart stalled queue!\n");
-    }
-
-    interruptSource->enable();
+    setInterruptSources(true);
     setTimers(true);
 
+    if (adapter->boot_phase[IGB_PHASE_LINK].start) {
+        igb_phase_end(adapter, IGB_PHASE_LINK);
+        publishBootPhases();
+    }
+
     pr_debug("[LU]: Link Up on en%u (%s), %s, %s, %s%s\n",
              netif->getUnitNumber(), deviceModelNames[chip_idx].name,
              speedName, duplexName, flowName, eeeName);
@@ -9530,20 +11259,14 @@ void AppleIGB::systemWillShutdown(IOOptionBits specifier)
  */
 void AppleIGB::setLinkDown()
 {
-        struct e1000_hw *hw = &priv_adapter.hw;
-        struct igb_adapter *adapter = &priv_adapter;
-
         pr_err("setLinkDown() ===>\n");
 
         linkUp = false;
-        /** igb_down also performs setLinkStatus(Valid) via netif_carrier_off */
-        igb_down(adapter);
-
-        clear_bit(__IGB_DOWN, &adapter->state);
-
-        /* Clear any pending interrupts. */
-        E1000_READ_REG(hw, E1000_ICR);
-        igb_irq_enable(adapter);
+        /**
+         * igb_down also performs setLinkStatus(Valid) via netif_carrier_off;
+         * phyRestartDone unmasks interrupts again to catch the next link up
+         */
+        phyRestart(false);
 
         pr_err("Link down on en%u\n", netif->getUnitNumber());
         pr_err("setLinkDown() <===\n");
@@ -9568,7 +11291,9 @@ UInt32 AppleIGB::outputPacket(mbuf_t skb, void * param)
 	// not applied to Mac OS X
 	// igb_xmit_frame_ring is inlined here
 	do {
-        struct igb_ring *tx_ring = igb_tx_queue_mapping(adapter, skb);
+        /* AppleIGBTxQueue passes the ring it picked for the packet */
+        struct igb_ring *tx_ring = param ? (struct igb_ring *)param :
+            igb_tx_queue_mapping(adapter, skb);
         struct igb_tx_buffer *first;
         int tso = 0;
         u32 tx_flags = 0;
@@ -9579,21 +11304,17 @@ UInt32 AppleIGB::outputPacket(mbuf_t skb, void * param)
          *       + 1 desc for context descriptor,
          * otherwise try next time */
         txNumFreeDesc = igb_desc_unused(tx_ring);
-        if (txNumFreeDesc < MAX_SKB_FRAGS + 3 //igb_maybe_stop_tx
-            || stalled) /** even if we have free desc we should exit in stalled mode as queue is enabled by threadsafe interrupts -> native igb code (see igb_poll) */
-        {
-            /* this is a hard error */
-			netStats->outputErrors += 1;
-#ifdef DEBUG
-            if (netStats->outputErrors % 100 == 0)
-                pr_debug("output: Dropping packets (%u), free\n", netStats->outputErrors);
-#endif
-            /* We should normally return kIOReturnOutputStall but a lot of other parts of code
-             * are not ready for this (kernel panic) further on mbuf_pkthdr_len
-             * so just error as in some other drivers hoping that upper layers will be able to
-             * handle this properly */
+        if (unlikely(tx_ring->tx_stopped || txNumFreeDesc < DESC_NEEDED)) {
+            /* AppleIGBTxQueue parks the packet on this ring's backlog and
+             * hands it back once igb_clean_tx_irq wakes the ring.
+             * Normally the ring was already stopped after the previous
+             * packet; if not, stop it now and retry if it just drained. */
+            if (!tx_ring->tx_stopped && !stopTxRing(tx_ring))
+                transmitQueue->service();
+            u64_stats_update_begin(&tx_ring->tx_syncp2);
+            tx_ring->tx_submit_stats.tx_busy++;
+            u64_stats_update_end(&tx_ring->tx_syncp2);
             result = kIOReturnOutputStall;
-            stalled = true;
             goto done;
         }
         /* record the location of the first descriptor for this packet */
@@ -9642,7 +11363,19 @@ UInt32 AppleIGB::outputPacket(mbuf_t skb, void * param)
 		}
 
 		/* Make sure there is space in the ring for the next send. */
-		//igb_maybe_stop_tx(tx_ring, MAX_SKB_FRAGS + 4);
+		if (unlikely(igb_desc_unused(tx_ring) < DESC_NEEDED))
+			stopTxRing(tx_ring);
+
+		/* one doorbell per burst: when enough descriptors are pending,
+		 * when the output queue is empty, or from the flush timer */
+		if (igb_tx_unflushed(tx_ring) >= txBatchDepth)
+			igb_tx_flush(tx_ring);
+		if (transmitQueue->getSize() == 0) {
+			flushTxRings();
+		} else if (tx_ring->tx_pending && !txFlushArmed) {
+			txFlushArmed = true;
+			txFlushSource->setTimeoutUS(IGB_TX_FLUSH_US);
+		}
     } while(false);
 
     result = kIOReturnOutputSuccess;
@@ -9665,7 +11398,335 @@ void AppleIGB::getPacketBufferConstraints(IOPacketBufferConstraints * constraint
 
 IOOutputQueue * AppleIGB::createOutputQueue()
 {
-	return IOGatedOutputQueue::withTarget(this, getWorkLoop());
+	return AppleIGBTxQueue::withTarget(this, getWorkLoop());
+}
+
+/* the ring outputPacket will put a frame on, for the submission ring */
+struct igb_ring * AppleIGB::txRingFor(mbuf_t m)
+{
+	return igb_tx_queue_mapping(&priv_adapter, m);
+}
+
+OSDefineMetaClassAndStructors(AppleIGBTxQueue, IOOutputQueue);
+
+AppleIGBTxQueue * AppleIGBTxQueue::withTarget(AppleIGB * target, IOWorkLoop * workLoop)
+{
+	AppleIGBTxQueue * queue = new AppleIGBTxQueue;
+
+	if (queue && !queue->initWithTarget(target, workLoop)) {
+		queue->release();
+		queue = NULL;
+	}
+	return queue;
+}
+
+bool AppleIGBTxQueue::initWithTarget(AppleIGB * target, IOWorkLoop * workLoop)
+{
+	UInt32 i;
+
+	if (!IOOutputQueue::init())
+		return false;
+
+	owner = target;
+	head = tail = 0;
+	limit = 0;
+	running = 0;
+	drainPending = 0;
+	drops = 0;
+	bzero(backlog, sizeof(backlog));
+	parked = 0;
+	outputs = retries = stalls = 0;
+
+	slots = (struct txq_slot *)IOMalloc(sizeof(struct txq_slot) * IGB_TXQ_SLOTS);
+	if (!slots)
+		return false;
+	for (i = 0; i < IGB_TXQ_SLOTS; i++) {
+		slots[i].seq = i;
+		slots[i].m = NULL;
+	}
+
+	drainSource = IOInterruptEventSource::interruptEventSource(this, &AppleIGBTxQueue::drainHandler);
+	if (!drainSource)
+		return false;
+	drainLoop = workLoop;
+	drainLoop->retain();
+	if (drainLoop->addEventSource(drainSource) != kIOReturnSuccess)
+		return false;
+
+	return true;
+}
+
+void AppleIGBTxQueue::free()
+{
+	if (drainSource) {
+		drainLoop->removeEventSource(drainSource);
+		RELEASE(drainSource);
+	}
+	RELEASE(drainLoop);
+	if (slots) {
+		flush();
+		IOFree(slots, sizeof(struct txq_slot) * IGB_TXQ_SLOTS);
+		slots = NULL;
+	}
+	IOOutputQueue::free();
+}
+
+/**
+ * push - add a packet to the bounded MPSC ring
+ * @m: packet chain to transmit
+ *
+ * A slot's seq tells producers and the consumer whose turn it is: seq ==
+ * pos means free for the producer claiming pos, seq == pos + 1 means
+ * filled for the consumer at pos, and pop hands it back for the next lap
+ * as pos + IGB_TXQ_SLOTS.  Only the head CAS is contended, so two
+ * producers can never fill the same slot, and the consumer pops in claim
+ * order.  Returns false when the ring is full.
+ **/
+bool AppleIGBTxQueue::push(mbuf_t m)
+{
+	struct txq_slot *slot;
+	UInt32 pos = head;
+	SInt32 dif;
+
+	for (;;) {
+		slot = &slots[pos & (IGB_TXQ_SLOTS - 1)];
+		dif = (SInt32)(slot->seq - pos);
+		if (dif == 0) {
+			if (OSCompareAndSwap(pos, pos + 1, &head))
+				break;
+		} else if (dif < 0) {
+			return false;	/* full */
+		}
+		pos = head;
+	}
+
+	slot->m = m;
+	/* publish the mbuf before handing the slot to the consumer */
+	OSMemoryBarrier();
+	slot->seq = pos + 1;
+	return true;
+}
+
+mbuf_t AppleIGBTxQueue::pop()
+{
+	struct txq_slot *slot = &slots[tail & (IGB_TXQ_SLOTS - 1)];
+	mbuf_t m;
+
+	if ((SInt32)(slot->seq - (tail + 1)) < 0)
+		return NULL;
+	OSMemoryBarrier();
+
+	m = slot->m;
+	slot->m = NULL;
+	OSMemoryBarrier();
+	slot->seq = tail + IGB_TXQ_SLOTS;
+	tail++;
+	return m;
+}
+
+/* schedule the consumer unless it is already on its way */
+void AppleIGBTxQueue::kick()
+{
+	if (OSCompareAndSwap(0, 1, &drainPending))
+		drainSource->interruptOccurred(NULL, NULL, 0);
+}
+
+/* from any thread, the packet is always consumed */
+UInt32 AppleIGBTxQueue::enqueue(mbuf_t m, void * param)
+{
+	if (!running || getSize() >= limit || !push(m)) {
+		OSIncrementAtomic((volatile SInt32 *)&drops);
+		mbuf_freem_list(m);
+		return 0;
+	}
+	kick();
+	return 0;
+}
+
+/* hand a packet to its ring, false if the ring is stopped */
+bool AppleIGBTxQueue::send(mbuf_t m, struct igb_ring *ring)
+{
+	UInt32 ret = owner->outputPacket(m, ring);
+
+	if (ret == kIOReturnOutputStall) {
+		retries++;
+		return false;
+	}
+	if (ret == kIOReturnOutputSuccess)
+		outputs++;
+	return true;
+}
+
+/* keep a packet, in order, until its ring is woken */
+void AppleIGBTxQueue::park(mbuf_t m, UInt32 i)
+{
+	struct txq_backlog *b = &backlog[i];
+
+	mbuf_setnextpkt(m, NULL);
+	if (b->tail)
+		mbuf_setnextpkt(b->tail, m);
+	else
+		b->head = m;
+	b->tail = m;
+	b->count++;
+	parked++;
+}
+
+void AppleIGBTxQueue::drain()
+{
+	struct igb_adapter *adapter = owner->adapter();
+	struct txq_backlog *b;
+	struct igb_ring *ring;
+	UInt32 budget = IGB_DEFAULT_TX_WORK, i;
+	mbuf_t m;
+
+	drainPending = 0;
+	/* producers that push after this point schedule another pass */
+	OSMemoryBarrier();
+
+	if (!running || owner->queueStopped())
+		return;
+
+	/* parked packets go first, a woken ring takes them back in order */
+	for (i = 0; parked && i < IGB_MAX_TX_QUEUES; i++) {
+		b = &backlog[i];
+		while ((m = b->head) != NULL) {
+			if (!budget--) {
+				kick();
+				return;
+			}
+			b->head = mbuf_nextpkt(m);
+			mbuf_setnextpkt(m, NULL);
+			if (!send(m, adapter->tx_ring[i])) {
+				mbuf_setnextpkt(m, b->head);
+				b->head = m;
+				break;
+			}
+			if (!b->head)
+				b->tail = NULL;
+			b->count--;
+			parked--;
+		}
+	}
+
+	while (running) {
+		if (!budget--) {
+			/* let the timers on this work loop run, then carry on */
+			kick();
+			break;
+		}
+		m = pop();
+		if (!m)
+			break;
+		ring = owner->txRingFor(m);
+		i = ring->queue_index;
+		b = &backlog[i];
+		if (b->head) {
+			/* behind earlier packets of a stopped ring */
+			park(m, i);
+		} else if (!send(m, ring)) {
+			/* retried from service() once the ring is woken */
+			stalls++;
+			park(m, i);
+		}
+		/* one ring stuck for this long holds everything back */
+		if (b->count >= IGB_TXQ_BACKLOG)
+			break;
+	}
+}
+
+void AppleIGBTxQueue::drainHandler(OSObject * target, IOInterruptEventSource * src, int count)
+{
+	((AppleIGBTxQueue *) target)->drain();
+}
+
+bool AppleIGBTxQueue::start()
+{
+	running = 1;
+	kick();
+	return true;
+}
+
+bool AppleIGBTxQueue::stop()
+{
+	bool wasRunning = running;
+
+	running = 0;
+	return wasRunning;
+}
+
+bool AppleIGBTxQueue::service(IOOptionBits options)
+{
+	kick();
+	return true;
+}
+
+/* only called on the controller work loop, so it may act as the consumer */
+UInt32 AppleIGBTxQueue::flush()
+{
+	UInt32 count = 0, i;
+	mbuf_t m;
+
+	for (i = 0; i < IGB_MAX_TX_QUEUES; i++) {
+		if (backlog[i].head)
+			mbuf_freem_list(backlog[i].head);
+		count += backlog[i].count;
+	}
+	bzero(backlog, sizeof(backlog));
+	parked = 0;
+	while ((m = pop()) != NULL) {
+		mbuf_freem_list(m);
+		count++;
+	}
+	return count;
+}
+
+bool AppleIGBTxQueue::setCapacity(UInt32 capacity)
+{
+	if (capacity > IGB_TXQ_SLOTS)
+		return false;
+	limit = capacity;
+	return true;
+}
+
+UInt32 AppleIGBTxQueue::getCapacity() const
+{
+	return limit;
+}
+
+UInt32 AppleIGBTxQueue::getSize() const
+{
+	UInt32 t = tail;
+
+	/* tail first: it only grows, so head - t can not go negative */
+	OSMemoryBarrier();
+	return (head - t) + parked;
+}
+
+UInt32 AppleIGBTxQueue::getDropCount()
+{
+	return drops;
+}
+
+UInt32 AppleIGBTxQueue::getOutputCount()
+{
+	return outputs;
+}
+
+UInt32 AppleIGBTxQueue::getRetryCount()
+{
+	return retries;
+}
+
+UInt32 AppleIGBTxQueue::getStallCount()
+{
+	return stalls;
+}
+
+UInt32 AppleIGBTxQueue::getState() const
+{
+	return (running ? kStateRunning : 0) |
+		   (parked ? kStateOutputStalled : 0);
 }
 
 const OSString * AppleIGB::newVendorString() const
@@ -9879,9 +11940,6 @@ void AppleIGB::intelRestart() {
         linkUp = false;
         eeeMode = 0;
 
-        while (test_and_set_bit(__IGB_RESETTING, &adapter->state))
-            usleep_range(1000, 2000);
-
         if (netif_running(this)) {
             /**
              * igb_down and igb_up do everything IntelMausi performs in its version:
@@ -9892,31 +11950,150 @@ void AppleIGB::intelRestart() {
              *  - configure
              *  - enable IRQ
              *  - start transmit queues
-             * So no obvious reason to avoid reusing as is.
+             * So no obvious reason to avoid reusing as is.  They run in steps
+             * off phySource so the work loop is not held while the MAC drains
+             * and the PHY settles.
              */
-            pr_debug("igb_down...\n");
-            igb_down(adapter);
-            pr_debug("igb_up...\n");
-            igb_up(adapter);
+            phyRestart(true);
         } else {
+            while (test_and_set_bit(__IGB_RESETTING, &adapter->state))
+                usleep_range(1000, 2000);
+
             pr_debug("igb_reset...\n");
             igb_reset(adapter);
-        }
 
-        clear_bit(__IGB_RESETTING, &adapter->state);
+            clear_bit(__IGB_RESETTING, &adapter->state);
+        }
         pr_debug("intelRestart <===\n");
 }
 
-IOReturn AppleIGB::selectMedium(const IONetworkMedium * medium)
+/**
+ * phyRestart - take the link down and back up without blocking
+ * @up: bring the rings back with igb_up, or only rearm the link interrupt
+ *
+ * Starts phyRestartStep, or joins the restart already running; a link
+ * down never cancels a pending restart.  Once igb_up has run the link is
+ * polled every 100 ms, in case the link change interrupt is missed, and a
+ * new restart may replace that poll.
+ **/
+void AppleIGB::phyRestart(bool up)
 {
-    pr_err("selectMedium()===>\n");
-
-    if (medium) {
-        intelSetupAdvForMedium(medium);
-        setCurrentMedium(medium);
+	if (phyState == kPhyLinkWait) {
+		phySource->cancelTimeout();
+		phyState = kPhyIdle;
+	}
+	if (phyState != kPhyIdle) {
+		phyRestartUp |= up;
+		return;
+	}
+	phyRestartUp = up;
+	phyRestarts++;
+	phyState = kPhyStart;
+	phyRestartStep();
+}
 
-        igb_update_stats(&priv_adapter);
+/**
+ * phyRestartStep - advance the restart by one step
+ *
+ * The waits the synchronous igb_down/igb_up sequence used to sleep
+ * through are phySource timeouts instead: 1 ms retries for
+ * __IGB_RESETTING, 10 ms for Rx/Tx DMA to drain and 100 ms link polls.
+ * The MAC reset in igb_reset still runs inline, as do the SFP cage
+ * power-up and PHY reset that the shared code does for SGMII ports.
+ **/
+void AppleIGB::phyRestartStep()
+{
+	struct igb_adapter *adapter = &priv_adapter;
+
+	switch (phyState) {
+	case kPhyStart:
+		/* igb_reinit_locked from resetSource owns the hardware */
+		if (test_and_set_bit(__IGB_RESETTING, &adapter->state)) {
+			phySource->setTimeoutMS(1);
+			break;
+		}
+		igb_down_quiesce(adapter);
+		phyState = kPhyQuiesce;
+		phySource->setTimeoutMS(10);
+		break;
+	case kPhyQuiesce:
+		igb_down_finish(adapter);
+		phyRestartDone();
+		break;
+	case kPhyLinkWait:
+		phyState = kPhyIdle;
+		if (!linkUp)
+			checkLinkStatus();
+		/* checkLinkStatus may have started another restart */
+		if (phyState != kPhyIdle)
+			break;
+		if (!linkUp && ++phyPolls < PHY_AUTO_NEG_LIMIT) {
+			phyState = kPhyLinkWait;
+			phySource->setTimeoutMS(100);
+			break;
+		}
+		setProperty("PhyLinkPolls", phyPolls, 32);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * phyRestartDone - hardware is reset, bring the interface back
+ **/
+void AppleIGB::phyRestartDone()
+{
+	struct igb_adapter *adapter = &priv_adapter;
+	struct e1000_hw *hw = &adapter->hw;
+
+	clear_bit(__IGB_RESETTING, &adapter->state);
+	setProperty("PhyRestarts", phyRestarts, 32);
+
+	if (!phyRestartUp) {
+		/* link down: rings stay empty, wait for the link interrupt */
+		clear_bit(__IGB_DOWN, &adapter->state);
+
+		/* Clear any pending interrupts. */
+		E1000_READ_REG(hw, E1000_ICR);
+		igb_irq_enable(adapter);
+		phyState = kPhyIdle;
+		return;
+	}
+
+	pr_debug("igb_up...\n");
+	igb_up(adapter);
+	phyPolls = 0;
+	phyState = kPhyLinkWait;
+	phySource->setTimeoutMS(100);
+}
+
+/**
+ * phyRestartCancel - stop a restart before igb_close
+ *
+ * igb_close runs the whole of igb_down again, so dropping the remaining
+ * steps is safe once __IGB_RESETTING is released.
+ **/
+void AppleIGB::phyRestartCancel()
+{
+	struct igb_adapter *adapter = &priv_adapter;
 
+	if (phySource)
+		phySource->cancelTimeout();
+	if (phyState == kPhyQuiesce)
+		clear_bit(__IGB_RESETTING, &adapter->state);
+	phyState = kPhyIdle;
+}
+
+IOReturn AppleIGB::selectMedium(const IONetworkMedium * medium)
+{
+    pr_err("selectMedium()===>\n");
+
+    if (medium) {
+        intelSetupAdvForMedium(medium);
+        setCurrentMedium(medium);
+
+        /* igb_down_finish reads the counters before the reset */
         intelRestart();
     } else {
         pr_err("Unexpected medium, ignoring.\n");
@@ -10204,7 +12381,7 @@ void AppleIGB::checkLinkStatus()
              * of the link parameters to make sure that the MAC is programmed correctly.
              */
             watchdogSource->cancelTimeout();
-            igb_update_stats(&priv_adapter);
+            /* igb_down_finish reads the counters before the reset */
             intelRestart();
         } else {
             /* Stop watchdog and statistics updates. */
@@ -10212,7 +12389,11 @@ void AppleIGB::checkLinkStatus()
             setLinkDown();
         }
     } else {
-        if (link) {
+        if (link && phyState != kPhyIdle) {
+            /* a restart owns the hardware, its link poll reports the link */
+            pr_debug("Link up deferred to the running restart\n");
+            phyRestartUp = true;
+        } else if (link) {
             /* Start rx/tx and inform upper layers that the link is up now. */
             setLinkUp();
             /* Perform live checks periodically. */
@@ -10229,9 +12410,21 @@ void AppleIGB::interruptOccurred(IOInterruptEventSource * src, int count)
 	struct igb_q_vector *q_vector = adapter->q_vector[0];
 	struct e1000_hw *hw = &adapter->hw;
 
+    u32 icr;
+
+    /* still masked from the last pass, ICR has nothing new for us */
+    if (legacyRepoll) {
+        legacyRepoll = false;
+        if (enabledForNetif && !pollQueueVector(q_vector)) {
+            legacyRepoll = true;
+            src->interruptOccurred(NULL, NULL, 0);
+        }
+        return;
+    }
+
     /* Interrupt Auto-Mask...upon reading ICR, interrupts are masked.  No
          * need for the IMC write */
-    u32 icr = E1000_READ_REG(hw, E1000_ICR);
+    icr = E1000_READ_REG(hw, E1000_ICR);
 
     if(!enabledForNetif) {
         pr_debug("Interrupt 0x%08x on disabled device\n", icr);
@@ -10260,8 +12453,9 @@ void AppleIGB::interruptOccurred(IOInterruptEventSource * src, int count)
 //		/* guard against interrupt when we're going down */
 //		if (!test_bit(__IGB_DOWN, &adapter->state))
 //			watchdogSource->setTimeoutMS(1);
-    } else {
-        igb_poll(q_vector, 64);
+    } else if (!pollQueueVector(q_vector)) {
+        legacyRepoll = true;
+        src->interruptOccurred(NULL, NULL, 0);
     }
 }
 
@@ -10271,6 +12465,683 @@ void AppleIGB::interruptHandler(OSObject * target, IOInterruptEventSource * src,
 	me->interruptOccurred(src, count);
 }
 
+// corresponds to igb_msix_other
+void AppleIGB::msixOtherOccurred(IOInterruptEventSource * src, int count)
+{
+	struct igb_adapter *adapter = &priv_adapter;
+	struct e1000_hw *hw = &adapter->hw;
+	/* reading ICR causes bit 31 of EICR to be cleared */
+	u32 icr = E1000_READ_REG(hw, E1000_ICR);
+
+	if(!enabledForNetif) {
+		pr_debug("Interrupt 0x%08x on disabled device\n", icr);
+		return;
+	}
+
+	if (icr & E1000_ICR_DRSTA)
+		resetSource->setTimeoutMS(1);
+
+	if (icr & E1000_ICR_DOUTSYNC) {
+		/* HW is reporting DMA is out of sync */
+		adapter->stats.doosync++;
+	}
+
+	if (icr & (E1000_ICR_RXSEQ | E1000_ICR_LSC))
+		checkLinkStatus();
+
+	E1000_WRITE_REG(hw, E1000_EIMS, adapter->eims_other);
+}
+
+// corresponds to igb_msix_ring
+void AppleIGB::msixRingOccurred(IOInterruptEventSource * src, int count)
+{
+	struct igb_adapter *adapter = &priv_adapter;
+	struct igb_q_vector *q_vector;
+
+	if(!enabledForNetif || test_bit(__IGB_DOWN, &adapter->state))
+		return;
+
+	/* the refcon is the vector index, the q_vector itself may be
+	 * reallocated by igb_reinit_queues while the source lives on */
+	q_vector = adapter->q_vector[(uintptr_t)src->getRefcon()];
+	if (q_vector == NULL)
+		return;
+
+	/* Write the ITR value calculated from the previous interrupt. */
+	igb_write_itr(q_vector);
+
+	/* the vector stays masked, so come back after the other events */
+	if (!pollQueueVector(q_vector))
+		src->interruptOccurred(NULL, NULL, 0);
+}
+
+/**
+ * pollQueueVector - service a vector until its rings are drained
+ * @q_vector: vector whose interrupt fired
+ *
+ * Stands in for the NAPI loop.  igb_poll only completes once a pass
+ * finishes under budget, so keep calling it until then, but no longer
+ * than IGB_POLL_BUDGET packets or IGB_POLL_US.  Returns false if it
+ * yielded with the vector still masked; the caller reschedules itself
+ * on the work loop so timers and other sources get a turn.  In busy
+ * poll mode a drained vector stays masked for another BusyPollUS, cut
+ * short by the same IGB_POLL_US deadline.
+ **/
+bool AppleIGB::pollQueueVector(struct igb_q_vector *q_vector)
+{
+	struct igb_adapter *adapter = &priv_adapter;
+	int work = 0;
+	u64 deadline, ready = 0;
+	bool done;
+
+	clock_interval_to_deadline(IGB_POLL_US, kMicrosecondScale, &deadline);
+	for (;;) {
+		done = !igb_poll(q_vector, IGB_POLL_WEIGHT);
+		if (ready) {
+			busyPollRecord(mach_absolute_time() - ready);
+			ready = 0;
+		}
+		if (done) {
+			if (busyPollUS)
+				ready = busyPollWait(q_vector, deadline);
+			if (!ready) {
+				igb_ring_irq_enable(q_vector);
+				return true;
+			}
+		} else {
+			work += IGB_POLL_WEIGHT;
+		}
+		/* igb_down masks everything and igb_up re-arms it */
+		if (test_bit(__IGB_DOWN, &adapter->state))
+			return true;
+		if (work >= IGB_POLL_BUDGET || mach_absolute_time() >= deadline)
+			return false;
+	}
+}
+
+/**
+ * busyPollWait - spin on a drained vector's next descriptors
+ * @q_vector: vector with its interrupt still masked
+ * @limit: pollQueueVector's deadline, the window never runs past it
+ *
+ * Watches the DD bit of the next Rx descriptor and of the oldest
+ * pending Tx packet for up to busyPollUS.  Returns the time the work
+ * was seen, or 0 once the window closes and the vector can be re-armed.
+ **/
+u64 AppleIGB::busyPollWait(struct igb_q_vector *q_vector, u64 limit)
+{
+	struct igb_adapter *adapter = &priv_adapter;
+	struct igb_ring *rx_ring = q_vector->rx.ring;
+	struct igb_ring *tx_ring = q_vector->tx.ring;
+	union e1000_adv_tx_desc *eop_desc;
+	u64 now, deadline;
+
+	clock_interval_to_deadline(busyPollUS, kMicrosecondScale, &deadline);
+	if (deadline > limit)
+		deadline = limit;
+	do {
+		if (test_bit(__IGB_DOWN, &adapter->state))
+			return 0;
+		now = mach_absolute_time();
+		if (rx_ring && igb_test_staterr(IGB_RX_DESC(rx_ring, rx_ring->next_to_clean),
+										E1000_RXD_STAT_DD))
+			return now;
+		if (tx_ring) {
+			eop_desc = tx_ring->tx_buffer_info[tx_ring->next_to_clean].next_to_watch;
+			if (eop_desc && (eop_desc->wb.status & cpu_to_le32(E1000_TXD_STAT_DD)))
+				return now;
+		}
+	} while (now < deadline);
+
+	return 0;
+}
+
+/* bucket i counts deliveries under 2^i us, the last one everything above */
+void AppleIGB::busyPollRecord(u64 elapsed)
+{
+	u64 ns;
+	UInt32 i = 0;
+
+	absolutetime_to_nanoseconds(elapsed, &ns);
+	while (i < IGB_BUSY_POLL_BUCKETS - 1 && ns / 1000 >= (1ULL << i))
+		i++;
+	OSIncrementAtomic((volatile SInt32 *) &busyPollHist[i]);
+}
+
+void AppleIGB::msixOtherHandler(OSObject * target, IOInterruptEventSource * src, int count)
+{
+	AppleIGB * me = (AppleIGB *) target;
+	me->msixOtherOccurred(src, count);
+}
+
+void AppleIGB::msixRingHandler(OSObject * target, IOInterruptEventSource * src, int count)
+{
+	AppleIGB * me = (AppleIGB *) target;
+	me->msixRingOccurred(src, count);
+}
+
+/**
+ * initInterruptSources - attach event sources for the chosen scheme
+ *
+ * With MSI-X, vector 0 takes link and other causes and every following
+ * vector drives one q_vector on a work loop of its own, so RSS queues
+ * and Tx completions are cleaned in parallel.  Tx completion does not
+ * need the controller gate that serializes outputPacket: the rings are
+ * handed over through next_to_use/next_to_clean as in the Linux driver.
+ * If the sources cannot be created, the adapter drops back to a single
+ * MSI or legacy vector.
+ **/
+bool AppleIGB::initInterruptSources()
+{
+	struct igb_adapter *adapter = &priv_adapter;
+	IOWorkLoop *wl;
+	UInt32 i;
+
+	if (adapter->msix_entries) {
+		for (i = 0; i < adapter->num_q_vectors + NON_Q_VECTORS; i++) {
+			msixSources[i] = IOInterruptEventSource::interruptEventSource(this,
+				i < NON_Q_VECTORS ? &AppleIGB::msixOtherHandler : &AppleIGB::msixRingHandler,
+				pdev, adapter->msix_entries[i].vector);
+			if (!msixSources[i])
+				break;
+			numMsixSources = i + 1;
+
+			wl = getWorkLoop();
+			if (i >= NON_Q_VECTORS) {
+				msixSources[i]->setRefcon((void *)(uintptr_t)(i - NON_Q_VECTORS));
+				wl = IOWorkLoop::workLoop();
+				if (!wl)
+					break;
+				queueWorkLoops[i - NON_Q_VECTORS] = wl;
+			}
+			wl->addEventSource(msixSources[i]);
+		}
+		if (i == adapter->num_q_vectors + NON_Q_VECTORS) {
+			initQueueStats();
+			return true;
+		}
+
+		pr_err("Failed to attach MSI-X vector %u. "
+			   "Falling back to MSI interrupts.\n", i);
+		releaseInterruptSources();
+		igb_clear_interrupt_scheme(adapter);
+		if (igb_init_interrupt_scheme(adapter, false))
+			return false;
+	}
+
+	interruptSource = IOInterruptEventSource::interruptEventSource(this,
+		&AppleIGB::interruptHandler, pdev,
+		(adapter->flags & IGB_FLAG_HAS_MSI) ? pci_msi_index(pdev) : 0);
+	if (!interruptSource) {
+		pr_err("Interrupt could not be enabled.\n");
+		return false;
+	}
+	getWorkLoop()->addEventSource(interruptSource);
+	/* the single vector is polled on the controller work loop, spinning
+	 * there would hold off the watchdog, the Tx flush timer and output */
+	if (busyPollUS) {
+		pr_err("BusyPollUS needs MSI-X, busy polling disabled.\n");
+		busyPollUS = 0;
+	}
+	initQueueStats();
+	return true;
+}
+
+void AppleIGB::setInterruptSources(bool enable)
+{
+	UInt32 i;
+
+	legacyRepoll = false;
+	if (interruptSource) {
+		if (enable)
+			interruptSource->enable();
+		else
+			interruptSource->disable();
+	}
+	for (i = 0; i < numMsixSources; i++) {
+		if (enable)
+			msixSources[i]->enable();
+		else
+			msixSources[i]->disable();
+	}
+}
+
+void AppleIGB::releaseInterruptSources()
+{
+	UInt32 i;
+
+	if (interruptSource) {
+		workLoop->removeEventSource(interruptSource);
+		RELEASE(interruptSource);
+	}
+	for (i = 0; i < numMsixSources; i++) {
+		if (msixSources[i]->getWorkLoop())
+			msixSources[i]->getWorkLoop()->removeEventSource(msixSources[i]);
+		RELEASE(msixSources[i]);
+	}
+	numMsixSources = 0;
+	for (i = 0; i < MAX_Q_VECTORS; i++)
+		RELEASE(queueWorkLoops[i]);
+}
+
+/**
+ * syncQueueWorkLoops - wait for every queue work loop to leave its poll
+ *
+ * Called with the controller work loop's gate held and takes each queue
+ * work loop's gate in turn.  That order is only safe because nothing
+ * running on a queue work loop ever takes the controller gate: the queue
+ * paths reach the controller only through IOInterruptEventSource::
+ * interruptOccurred and IOTimerEventSource::setTimeout* (scheduleReset,
+ * wakeTxRing, receive), which signal its thread without closing its
+ * gate.  Anything added to igb_poll must keep it that way.
+ **/
+void AppleIGB::syncQueueWorkLoops()
+{
+	UInt32 i;
+
+	assert(getWorkLoop()->inGate());
+
+	for (i = 0; i < MAX_Q_VECTORS; i++) {
+		if (queueWorkLoops[i]) {
+			queueWorkLoops[i]->closeGate();
+			queueWorkLoops[i]->openGate();
+		}
+	}
+}
+
+/**
+ * igb_rx_ring_stats - consistent copy of a ring's receive counters
+ * @ring: Rx ring
+ * @stats: filled in
+ *
+ * Lock free and safe from any thread: the counters are re-read until
+ * no writer was in the middle of an update.  Drops are kept apart in
+ * rx_drops under rx_syncp2, rx_stats.drops is never written.
+ **/
+static void igb_rx_ring_stats(struct igb_ring *ring, struct igb_rx_queue_stats *stats)
+{
+	unsigned int start;
+	u64 drops;
+
+	do {
+		start = u64_stats_fetch_begin(&ring->rx_syncp);
+		*stats = ring->rx_stats;
+	} while (u64_stats_fetch_retry(&ring->rx_syncp, start));
+	do {
+		start = u64_stats_fetch_begin(&ring->rx_syncp2);
+		drops = ring->rx_drops;
+	} while (u64_stats_fetch_retry(&ring->rx_syncp2, start));
+	stats->drops = drops;
+}
+
+/* the same for transmit, cleanup and transmit path counters separately */
+static void igb_tx_ring_stats(struct igb_ring *ring, struct igb_tx_queue_stats *stats,
+			      struct igb_tx_submit_stats *submit)
+{
+	unsigned int start;
+
+	do {
+		start = u64_stats_fetch_begin(&ring->tx_syncp);
+		stats->packets = ring->tx_stats.packets;
+		stats->bytes = ring->tx_stats.bytes;
+		stats->restart_queue = ring->tx_stats.restart_queue;
+	} while (u64_stats_fetch_retry(&ring->tx_syncp, start));
+	do {
+		start = u64_stats_fetch_begin(&ring->tx_syncp2);
+		*submit = ring->tx_submit_stats;
+	} while (u64_stats_fetch_retry(&ring->tx_syncp2, start));
+}
+
+/* a fresh number under @key, published dictionaries are never changed */
+static void setQueueStat(OSDictionary *dict, const char *key, u64 value)
+{
+	OSNumber *num = OSNumber::withNumber((unsigned long long)value, 64);
+
+	if (num) {
+		dict->setObject(key, num);
+		num->release();
+	}
+}
+
+/* a fresh array of 32 bit counts, one per histogram bucket */
+static OSArray *newHistogram(const volatile u32 *counts, int buckets)
+{
+	OSArray *array = OSArray::withCapacity(buckets);
+	OSNumber *num;
+	int i;
+
+	for (i = 0; array && i < buckets; i++) {
+		num = OSNumber::withNumber((unsigned long long)counts[i], 32);
+		if (num) {
+			array->setObject(num);
+			num->release();
+		}
+	}
+	return array;
+}
+
+static void setTimerStat(OSDictionary *dict, const char *key, u32 calls, u64 ns)
+{
+	OSDictionary *entry = OSDictionary::withCapacity(2);
+	OSNumber *num;
+
+	if (!entry)
+		return;
+	num = OSNumber::withNumber(calls, 32);
+	if (num) {
+		entry->setObject("Calls", num);
+		num->release();
+	}
+	num = OSNumber::withNumber(ns / NSEC_PER_USEC, 64);
+	if (num) {
+		entry->setObject("TimeUS", num);
+		num->release();
+	}
+	dict->setObject(key, entry);
+	entry->release();
+}
+
+/**
+ * publishBootPhases - publish where bring-up time went
+ *
+ * "BootPhases" holds the igb_boot_phase timers of this port, "SleepSites"
+ * the msleep/mdelay totals of every port by calling function (only built
+ * with IGB_DEBUG_SLEEP_SITES) and "NVMShadow" how many NVM reads the
+ * shadow absorbed.  All are rebuilt
+ * after probe, after enable() and on the first link up.
+ **/
+void AppleIGB::publishBootPhases()
+{
+	static const char * const phaseNames[IGB_PHASE_COUNT] = {
+		"Probe", "SetupInitFuncs", "SwInit", "NVM", "Reset",
+		"Open", "RingAlloc", "PhyPowerUp", "Configure", "LinkReady"
+	};
+	struct igb_adapter *adapter = &priv_adapter;
+	OSDictionary *dict;
+	int i;
+
+	dict = OSDictionary::withCapacity(IGB_PHASE_COUNT);
+	if (dict) {
+		for (i = 0; i < IGB_PHASE_COUNT; i++) {
+			if (adapter->boot_phase[i].count)
+				setTimerStat(dict, phaseNames[i],
+					     adapter->boot_phase[i].count,
+					     adapter->boot_phase[i].ns);
+		}
+		setProperty("BootPhases", dict);
+		dict->release();
+	}
+
+#ifdef IGB_DEBUG_SLEEP_SITES
+	dict = OSDictionary::withCapacity(IGB_SLEEP_SITES);
+	if (dict) {
+		for (i = 0; i < IGB_SLEEP_SITES && igb_sleep_sites[i].site; i++)
+			setTimerStat(dict, (const char *)igb_sleep_sites[i].site,
+				     igb_sleep_sites[i].calls,
+				     igb_sleep_sites[i].ns);
+		setProperty("SleepSites", dict);
+		dict->release();
+	}
+#endif
+
+	dict = OSDictionary::withCapacity(3);
+	if (dict) {
+		OSNumber *num;
+
+		num = OSNumber::withNumber(adapter->nvm_shadow_valid ?
+					   adapter->nvm_shadow_words : 0, 32);
+		if (num) {
+			dict->setObject("Words", num);
+			num->release();
+		}
+		num = OSNumber::withNumber(adapter->nvm_shadow_hits, 32);
+		if (num) {
+			dict->setObject("Hits", num);
+			num->release();
+		}
+		num = OSNumber::withNumber(adapter->nvm_hw_words, 32);
+		if (num) {
+			dict->setObject("HardwareWords", num);
+			num->release();
+		}
+		setProperty("NVMShadow", dict);
+		dict->release();
+	}
+}
+
+/**
+ * initQueueStats - publish per-queue packet counters
+ *
+ * One dictionary per ring under "RxQueueStats" and "TxQueueStats".
+ * updateQueueStats rebuilds them from igb_rx_ring_stats/igb_tx_ring_stats
+ * snapshots, on every watchdog pass or when RefreshQueueStats is set
+ * through setProperties, and replaces the published objects rather than
+ * changing them under a reader.
+ **/
+void AppleIGB::initQueueStats()
+{
+	struct igb_adapter *adapter = &priv_adapter;
+
+	lastStatsReads = adapter->stats_reads;
+	lastStatsTime = mach_absolute_time();
+	setProperty("StatsRegisterReadsPerSecond", 0ULL, 32);
+	updateQueueStats();
+}
+
+void AppleIGB::updateQueueStats()
+{
+	struct igb_adapter *adapter = &priv_adapter;
+	struct igb_rx_queue_stats rx;
+	struct igb_tx_queue_stats tx;
+	struct igb_tx_submit_stats submit;
+	struct igb_ring *ring;
+	OSArray *stats;
+	OSDictionary *dict;
+	u64 doorbells = 0, doorbell_pkts = 0, batches, batch_pkts;
+	u64 now, elapsed;
+	int i;
+
+	stats = OSArray::withCapacity(adapter->num_rx_queues);
+	for (i = 0; stats && i < adapter->num_rx_queues; i++) {
+		ring = adapter->rx_ring[i];
+		dict = OSDictionary::withCapacity(12);
+		if (!dict)
+			break;
+		if (ring) {
+			igb_rx_ring_stats(ring, &rx);
+			setQueueStat(dict, "Packets", rx.packets);
+			setQueueStat(dict, "Bytes", rx.bytes);
+			setQueueStat(dict, "Drops", rx.drops);
+			setQueueStat(dict, "AllocFailed", rx.alloc_failed);
+			setQueueStat(dict, "CsumErrors", rx.csum_err);
+			setQueueStat(dict, "Loaned", rx.loaned);
+			setQueueStat(dict, "CopiedBytes", rx.copied_bytes);
+			setQueueStat(dict, "PoolHits", rx.pool_hits);
+			setQueueStat(dict, "PoolMisses", rx.pool_misses);
+			setQueueStat(dict, "HeaderSplit", rx.hdr_split);
+			if (ring->q_vector)
+				setQueueStat(dict, "ItrUS", ring->q_vector->itr_val >> 2);
+			/* the pool is freed by igb_close, also on this work loop */
+			if (ring->rx_pool)
+				setQueueStat(dict, "WiredBytes",
+					     igb_rx_pool_wired(ring->rx_pool));
+		}
+		stats->setObject(dict);
+		dict->release();
+	}
+	if (stats) {
+		setProperty("RxQueueStats", stats);
+		stats->release();
+	}
+
+	stats = OSArray::withCapacity(adapter->num_tx_queues);
+	for (i = 0; stats && i < adapter->num_tx_queues; i++) {
+		ring = adapter->tx_ring[i];
+		dict = OSDictionary::withCapacity(6);
+		if (!dict)
+			break;
+		if (ring) {
+			igb_tx_ring_stats(ring, &tx, &submit);
+			setQueueStat(dict, "Packets", tx.packets);
+			setQueueStat(dict, "Bytes", tx.bytes);
+			setQueueStat(dict, "Stops", submit.stops);
+			setQueueStat(dict, "Wakes", tx.restart_queue);
+			setQueueStat(dict, "Busy", submit.tx_busy);
+			setQueueStat(dict, "Doorbells", submit.doorbells);
+			doorbells += submit.doorbells;
+			doorbell_pkts += submit.doorbell_pkts;
+		}
+		stats->setObject(dict);
+		dict->release();
+	}
+	if (stats) {
+		setProperty("TxQueueStats", stats);
+		stats->release();
+	}
+
+	/* rounded to the nearest packet */
+	setProperty("TxPacketsPerDoorbell", doorbells ?
+		    (doorbell_pkts + doorbells / 2) / doorbells : 0, 32);
+	/* rounded like the doorbell batch; the pair is read as receive() sets it */
+	IOSimpleLockLock(rxPendingLock);
+	batches = rxBatches;
+	batch_pkts = rxBatchPackets;
+	IOSimpleLockUnlock(rxPendingLock);
+	setProperty("RxPacketsPerInput", batches ?
+		    (batch_pkts + batches / 2) / batches : 0, 32);
+	/* from the totals igb_update_stats gathers off the queue vectors */
+	setProperty("LROSegmentsPerFrame", adapter->lro_stats.flushed ?
+		    ((u64)adapter->lro_stats.coal + adapter->lro_stats.flushed / 2) /
+		    adapter->lro_stats.flushed : 0, 32);
+
+	now = mach_absolute_time();
+	absolutetime_to_nanoseconds(now - lastStatsTime, &elapsed);
+	if (elapsed >= NSEC_PER_SEC / 2) {
+		setProperty("StatsRegisterReadsPerSecond",
+			    (adapter->stats_reads - lastStatsReads) *
+			    NSEC_PER_SEC / elapsed, 32);
+		lastStatsReads = adapter->stats_reads;
+		lastStatsTime = now;
+	}
+
+	/* how long the hot and the full statistics passes take */
+	dict = OSDictionary::withCapacity(2);
+	if (dict) {
+		setTimerStat(dict, "Hot", adapter->stats_passes[0], adapter->stats_ns[0]);
+		setTimerStat(dict, "Full", adapter->stats_passes[1], adapter->stats_ns[1]);
+		setProperty("StatsPasses", dict);
+		dict->release();
+	}
+
+	/* only with BusyPollUS set, one count per power of two microseconds */
+	if (busyPollUS) {
+		stats = newHistogram(busyPollHist, IGB_BUSY_POLL_BUCKETS);
+		if (stats) {
+			setProperty("BusyPollLatency", stats);
+			stats->release();
+		}
+	}
+
+	/* MDIC completion waits, bucket i holds waits under 32 << i us */
+	stats = newHistogram(adapter->mdic_wait_hist, IGB_MDIC_BUCKETS);
+	if (stats) {
+		setProperty("MDICWaitUS", stats);
+		stats->release();
+	}
+	setProperty("MDICTimeouts", adapter->mdic_timeouts, 32);
+}
+
+/* from outputPacket once the submission ring is empty and from the flush
+ * timer, both on the controller work loop */
+void AppleIGB::flushTxRings()
+{
+	struct igb_adapter *adapter = &priv_adapter;
+	int i;
+
+	if (test_bit(__IGB_DOWN, &adapter->state))
+		return;
+
+	for (i = 0; i < adapter->num_tx_queues; i++) {
+		if (adapter->tx_ring[i])
+			igb_tx_flush(adapter->tx_ring[i]);
+	}
+}
+
+/**
+ * stopTxRing - stop transmit at the high watermark
+ * @tx_ring: ring with fewer than DESC_NEEDED free descriptors
+ *
+ * Returns true if the queue stays stopped.  igb_clean_tx_irq clears
+ * tx_stopped and wakes the queue at IGB_TX_WAKE_THRESH free descriptors.
+ * tx_stopped is the only stop state, so a cleaner that clears it between
+ * here and the re-check has already kicked the queue.
+ **/
+bool AppleIGB::stopTxRing(struct igb_ring *tx_ring)
+{
+	OSCompareAndSwap(0, 1, &tx_ring->tx_stopped);
+	/* the hardware must see what is queued to free anything */
+	igb_tx_flush(tx_ring);
+
+	/* publish the stop before looking at next_to_clean again, a queue
+	 * work loop may have freed descriptors without seeing it */
+	OSMemoryBarrier();
+	if (igb_desc_unused(tx_ring) < DESC_NEEDED) {
+		u64_stats_update_begin(&tx_ring->tx_syncp2);
+		tx_ring->tx_submit_stats.stops++;
+		u64_stats_update_end(&tx_ring->tx_syncp2);
+		return true;
+	}
+
+	OSCompareAndSwap(1, 0, &tx_ring->tx_stopped);
+	return false;
+}
+
+/**
+ * wakeTxRing - restart transmit on a ring stopped at the high watermark
+ * @tx_ring: ring igb_clean_tx_irq has freed descriptors on
+ *
+ * Runs on the ring's queue work loop.  Only clears the stop state and
+ * schedules the submission ring's drain on the controller work loop;
+ * the memory cursor and the queue itself are left to startTxQueue.
+ * Returns true if this call woke the ring.
+ **/
+bool AppleIGB::wakeTxRing(struct igb_ring *tx_ring)
+{
+	if (!OSCompareAndSwap(1, 0, &tx_ring->tx_stopped))
+		return false;
+	if (transmitQueue)
+		transmitQueue->service();
+	return true;
+}
+
+void AppleIGB::txFlushHandler(OSObject * target, IOTimerEventSource * src)
+{
+	AppleIGB* me = (AppleIGB*) target;
+
+	me->txFlushArmed = false;
+	me->flushTxRings();
+}
+
+void AppleIGB::phyHandler(OSObject * target, IOTimerEventSource * src)
+{
+	AppleIGB* me = (AppleIGB*) target;
+
+	me->phyRestartStep();
+}
+
+/* called from a queue work loop, so the reset runs on the controller's */
+void AppleIGB::scheduleReset()
+{
+	struct igb_adapter *adapter = &priv_adapter;
+	int i;
+
+	/* hold transmit on every ring, igb_up clears tx_stopped again */
+	for (i = 0; i < adapter->num_tx_queues; i++) {
+		if (adapter->tx_ring[i])
+			OSCompareAndSwap(0, 1, &adapter->tx_ring[i]->tx_stopped);
+	}
+	resetSource->setTimeoutMS(1);
+}
 
 // corresponds to igb_watchdog_task	
 void AppleIGB::watchdogTask()
@@ -10279,7 +13150,8 @@ void AppleIGB::watchdogTask()
 	struct e1000_hw *hw = &adapter->hw;
 	int i;
 
-	igb_update_stats(adapter);
+	igb_update_stats_periodic(adapter);
+	updateQueueStats();
 
     for (i = 0; i < adapter->num_tx_queues; i++) {
         struct igb_ring *tx_ring = adapter->tx_ring[i];
@@ -10443,18 +13315,14 @@ UInt32 AppleIGB::getFeatures() const {
  **/
 
 
+/* enable and link up only, ring wakes go through wakeTxRing */
 void AppleIGB::startTxQueue()
 {
     DEBUGFUNC("AppleIGB::startTxQueue\n");
-    if (likely(stalled && txMbufCursor && transmitQueue)) {
-        pr_debug("Assuming wake queue called.\n");
-        transmitQueue->service(IOBasicOutputQueue::kServiceAsync);
-    } else {
+    if (!txMbufCursor)
         txMbufCursor = IOMbufNaturalMemoryCursor::withSpecification(_mtu + ETH_HLEN + ETH_FCS_LEN + VLAN_HLEN, MAX_SKB_FRAGS);
-        if(txMbufCursor && transmitQueue)
-            transmitQueue->start();
-    }
-    stalled = false;
+    if (txMbufCursor && transmitQueue)
+        transmitQueue->start();
 }
 
 void AppleIGB::stopTxQueue()
@@ -10506,9 +13374,65 @@ void AppleIGB::setCarrier(bool stat)
     pr_debug("setCarrier() <===\n");
 }
 	
-void AppleIGB::receive(mbuf_t skb)
+/**
+ * receive - hand one poll's frames to the stack
+ * @skb: frames linked through their packet pointers
+ * @tail: last frame in the list
+ * @count: number of frames in the list
+ *
+ * IONetworkInterface keeps a single input queue with no locking of its
+ * own, so with RSS the queue work loops must not fill or flush it at the
+ * same time; rxInputLock makes one of them the deliverer.  The others
+ * only append their list to rxPending under a spin lock and return, and
+ * the deliverer picks it up before letting go, so no queue work loop
+ * waits for another's delivery.  Each list keeps its place in rxPending,
+ * so frames of a queue reach the stack in order.
+ *
+ * The try lock only fails while a deliverer holds rxInputLock, and that
+ * deliverer re-checks rxPending after it unlocks, so a list parked at any
+ * point before the unlock is still delivered, by it or by the next
+ * caller that wins the lock.  rxBatches and rxBatchPackets are counted
+ * under rxPendingLock when a list is taken, so updateQueueStats reads a
+ * matching pair.
+ **/
+void AppleIGB::receive(mbuf_t skb, mbuf_t tail, UInt32 count)
 {
-	netif->inputPacket(skb, mbuf_pkthdr_len(skb));
+	mbuf_t next;
+
+	IOSimpleLockLock(rxPendingLock);
+	if (rxPendingTail)
+		mbuf_setnextpkt(rxPendingTail, skb);
+	else
+		rxPending = skb;
+	rxPendingTail = tail;
+	rxPendingCount += count;
+	IOSimpleLockUnlock(rxPendingLock);
+
+	/* re-checked after the unlock, a list parked meanwhile is not lost */
+	while (rxPending && IOLockTryLock(rxInputLock)) {
+		IOSimpleLockLock(rxPendingLock);
+		skb = rxPending;
+		count = rxPendingCount;
+		rxPending = NULL;
+		rxPendingTail = NULL;
+		rxPendingCount = 0;
+		if (skb) {
+			rxBatches++;
+			rxBatchPackets += count;
+		}
+		IOSimpleLockUnlock(rxPendingLock);
+
+		if (skb) {
+			for (; skb; skb = next) {
+				next = mbuf_nextpkt(skb);
+				mbuf_setnextpkt(skb, NULL);
+				netif->inputPacket(skb, mbuf_pkthdr_len(skb),
+						   IONetworkInterface::kInputOptionQueuePacket);
+			}
+			netif->flushInputQueue();
+		}
+		IOLockUnlock(rxInputLock);
+	}
 }
 
 void AppleIGB::setVid(mbuf_t skb, UInt16 vid)
@@ -10525,6 +13449,8 @@ void AppleIGB::setTimers(bool enable)
             resetSource->enable();
         if(dmaErrSource)
             dmaErrSource->enable();
+        if(txFlushSource)
+            txFlushSource->enable();
     } else {
         if(watchdogSource)
             watchdogSource->disable();
@@ -10532,6 +13458,8 @@ void AppleIGB::setTimers(bool enable)
             resetSource->disable();
         if(dmaErrSource)
             dmaErrSource->disable();
+        if(txFlushSource)
+            txFlushSource->disable();
     }
 }
    
@@ -47,6 +47,14 @@ enum {
     kEEETypeCount
 };
 
+/* steps of the timer driven restart, see phyRestartStep */
+enum {
+    kPhyIdle = 0,
+    kPhyStart,      /* waiting for __IGB_RESETTING */
+    kPhyQuiesce,    /* Rx/Tx disabled, in-flight DMA draining */
+    kPhyLinkWait    /* polling for link after igb_up */
+};
+
 #define super IOEthernetController
 
 class AppleIGB: public super
@@ -110,6 +118,8 @@ public:
     virtual IOReturn getPacketFilters(const OSSymbol * group, UInt32 * filters) const;
     virtual UInt32 getFeatures() const;
 
+	virtual IOReturn setProperties(OSObject *properties);
+
 private:
 	IOWorkLoop* workLoop;
 	IOPCIDevice* pdev;
@@ -118,9 +128,27 @@ private:
 	IOOutputQueue * transmitQueue;
 	
 	IOInterruptEventSource * interruptSource;
+	IOInterruptEventSource * msixSources[MAX_Q_VECTORS + NON_Q_VECTORS];
+	UInt32 numMsixSources;
+	IOWorkLoop * queueWorkLoops[MAX_Q_VECTORS];
+	IOLock * rxInputLock;
+	IOSimpleLock * rxPendingLock;
+	mbuf_t rxPending;
+	mbuf_t rxPendingTail;
+	UInt32 rxPendingCount;
+	u64 rxBatches;
+	u64 rxBatchPackets;
+	u64 lastStatsReads;
+	u64 lastStatsTime;
 	IOTimerEventSource * watchdogSource;
 	IOTimerEventSource * resetSource;
 	IOTimerEventSource * dmaErrSource;
+	IOTimerEventSource * txFlushSource;
+	IOTimerEventSource * phySource;
+	UInt32 phyState;
+	UInt32 phyPolls;
+	UInt32 phyRestarts;
+	bool phyRestartUp;
 
 	IOEthernetInterface * netif;
 	IONetworkStats * netStats;
@@ -133,9 +161,12 @@ private:
 	bool enabledForNetif;
 	bool bSuspended;
 	bool useTSO;
+	bool useRxZeroCopy;
+	bool useRxHeaderSplit;
+	bool txFlushArmed;
+	bool legacyRepoll;
 
     bool linkUp;
-    bool stalled;
 
     UInt16 eeeMode;
 
@@ -145,6 +176,9 @@ private:
 	UInt32 powerState;
 	UInt32 _mtu;
     SInt32 txNumFreeDesc;
+	UInt32 txBatchDepth;
+	UInt32 busyPollUS;
+	volatile UInt32 busyPollHist[IGB_BUSY_POLL_BUCKETS];
 
     UInt32 chip_idx;
 
@@ -152,6 +186,7 @@ private:
 public:
 	void startTxQueue();
 	void stopTxQueue();
+	bool wakeTxRing(struct igb_ring *tx_ring);
 	UInt32 mtu() { return _mtu; }
 	UInt32 flags(){ return iff_flags;}
 	UInt32 features() { return _features; }
@@ -159,23 +194,34 @@ public:
 	IONetworkStats* getNetStats(){ return netStats; }
 	IOEthernetStats* getEtherStats() { return etherStats; }
 	dma_addr_t mapSingle( mbuf_t );
-	void receive(mbuf_t skb );
+	void receive(mbuf_t skb, mbuf_t tail, UInt32 count);
 	void setVid(mbuf_t skb, UInt16 vid);
 	IOMbufNaturalMemoryCursor * txCursor(){ return txMbufCursor; }
 	void rxChecksumOK( mbuf_t, UInt32 flag );
+	bool rxZeroCopy(){ return useRxZeroCopy; }
+	bool rxHeaderSplit(){ return useRxHeaderSplit; }
 	bool running(){return enabledForNetif;}
-	bool queueStopped(){return txMbufCursor == NULL || stalled;}
+	bool queueStopped(){return txMbufCursor == NULL;}
+	struct igb_ring * txRingFor(mbuf_t m);
 	bool carrier();
 	void setCarrier(bool);
     
     void setTimers(bool enable);
+	void syncQueueWorkLoops();
+	void scheduleReset();
 private:
 	void interruptOccurred(IOInterruptEventSource * src, int count);
+	void msixOtherOccurred(IOInterruptEventSource * src, int count);
+	void msixRingOccurred(IOInterruptEventSource * src, int count);
 	
 	void watchdogTask();
 	void updatePhyInfoTask();
 
     void intelRestart();
+    void phyRestart(bool up);
+    void phyRestartStep();
+    void phyRestartDone();
+    void phyRestartCancel();
     bool intelCheckLink(struct igb_adapter *adapter);
     void setLinkUp();
     void setLinkDown();
@@ -189,23 +235,129 @@ private:
 	bool addNetworkMedium(UInt32 type, UInt32 bps, UInt32 index);
 
 	bool initEventSources( IOService* provider );
+	bool initInterruptSources();
+	void setInterruptSources(bool enable);
+	void releaseInterruptSources();
+	void initQueueStats();
+	void updateQueueStats();
+	void publishBootPhases();
+	void flushTxRings();
+	bool stopTxRing(struct igb_ring *tx_ring);
+	bool pollQueueVector(struct igb_q_vector *q_vector);
+	u64 busyPollWait(struct igb_q_vector *q_vector, u64 limit);
+	void busyPollRecord(u64 elapsed);
 
 	bool igb_probe();
 	void igb_remove();
 
 	bool getBoolOption(const char *name, bool defVal);
 	int getIntOption(const char *name, int defVal, int maxVal, int minVal );
+	IOReturn setLowLatencyInterrupts(OSDictionary *dict);
 
 public:
 	static void interruptHandler(OSObject * target,
 								 IOInterruptEventSource * src,
 								 int count );
+	static void msixOtherHandler(OSObject * target,
+								 IOInterruptEventSource * src,
+								 int count );
+	static void msixRingHandler(OSObject * target,
+								IOInterruptEventSource * src,
+								int count );
 	
 	
 
 	static void watchdogHandler(OSObject * target, IOTimerEventSource * src);
 	static void resetHandler(OSObject * target, IOTimerEventSource * src);
+	static void txFlushHandler(OSObject * target, IOTimerEventSource * src);
+	static void phyHandler(OSObject * target, IOTimerEventSource * src);
+	static IOReturn setPropertiesGated(OSObject *owner, void *arg0, void *arg1, void *arg2, void *arg3);
+
+};
+
+#define IGB_TXQ_SLOTS	2048	/* power of two, >= IGB_DEFAULT_TXD */
+#define IGB_TXQ_BACKLOG	64		/* packets parked for one stopped ring */
+
+/**
+ * AppleIGBTxQueue - multi-producer transmit submission ring
+ *
+ * A plain IOOutputQueue, none of IOBasicOutputQueue's own queue is used.
+ * enqueue() may be called from any thread; it never blocks or takes a
+ * work loop gate, and always consumes the packet: it is either pushed
+ * into a bounded lock-free ring or freed and counted in getDropCount()
+ * when the queue is stopped or full.  service() only schedules the
+ * drain and may also be called from any thread.  start(), stop(),
+ * flush() and setCapacity() belong to the controller work loop, where
+ * the single consumer runs.
+ *
+ * The consumer picks each packet's ring and hands it to outputPacket.
+ * A packet for a ring that refuses it with kIOReturnOutputStall is
+ * parked on that ring's backlog, and so are later packets for the same
+ * ring, while packets for other rings keep flowing.  Only once a ring
+ * has IGB_TXQ_BACKLOG packets parked does the drain stop altogether
+ * until that ring is woken.  getSize() counts ring and backlogs; seen
+ * from a producer it may be high by the packets drained meanwhile.
+ **/
+class AppleIGBTxQueue: public IOOutputQueue
+{
+	OSDeclareDefaultStructors(AppleIGBTxQueue);
+
+public:
+	static AppleIGBTxQueue * withTarget(AppleIGB * target, IOWorkLoop * workLoop);
+
+	virtual UInt32 enqueue(mbuf_t m, void * param);
+	virtual bool start();
+	virtual bool stop();
+	virtual bool service(IOOptionBits options = 0);
+	virtual UInt32 flush();
+	virtual bool setCapacity(UInt32 capacity);
+	virtual UInt32 getCapacity() const;
+	virtual UInt32 getSize() const;
+	virtual UInt32 getDropCount();
+	virtual UInt32 getOutputCount();
+	virtual UInt32 getRetryCount();
+	virtual UInt32 getStallCount();
+	virtual UInt32 getState() const;
+
+protected:
+	virtual bool initWithTarget(AppleIGB * target, IOWorkLoop * workLoop);
+	virtual void free();
+
+private:
+	struct txq_slot {
+		volatile UInt32 seq;
+		mbuf_t m;
+	};
+	struct txq_backlog {
+		mbuf_t head;
+		mbuf_t tail;
+		UInt32 count;
+	};
+
+	AppleIGB * owner;
+	IOWorkLoop * drainLoop;
+	IOInterruptEventSource * drainSource;
+	struct txq_slot * slots;
+	volatile UInt32 head;		/* next slot claimed by a producer */
+	volatile UInt32 tail;		/* next slot drained by the consumer */
+	volatile UInt32 limit;		/* capacity set by the controller */
+	volatile UInt32 running;
+	volatile UInt32 drainPending;
+	volatile UInt32 drops;
+	/* consumer side, controller work loop only */
+	struct txq_backlog backlog[IGB_MAX_TX_QUEUES];
+	volatile UInt32 parked;
+	UInt32 outputs;
+	UInt32 retries;
+	UInt32 stalls;
 
+	bool push(mbuf_t m);
+	mbuf_t pop();
+	void kick();
+	bool send(mbuf_t m, struct igb_ring *ring);
+	void park(mbuf_t m, UInt32 i);
+	void drain();
+	static void drainHandler(OSObject * target, IOInterruptEventSource * src, int count);
 };
 
 
@@ -106,6 +106,13 @@ struct e1000_adv_context_desc {
 #define E1000_SRRCTL_BSIZEPKT_MASK		0x0000007F
 #define E1000_SRRCTL_BSIZEHDR_MASK		0x00003F00
 
+/* PSRTYPE bit definitions */
+#define E1000_PSRTYPE_TCPHDR			0x00000010
+#define E1000_PSRTYPE_UDPHDR			0x00000020
+#define E1000_PSRTYPE_IPV4HDR			0x00000100
+#define E1000_PSRTYPE_IPV6HDR			0x00000200
+#define E1000_PSRTYPE_L2HDR			0x00001000
+
 #define E1000_TX_HEAD_WB_ENABLE		0x1
 #define E1000_TX_SEQNUM_WB_ENABLE	0x2
 
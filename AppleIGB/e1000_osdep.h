@@ -88,6 +88,7 @@ do { \
 } while (0)
 
 u32 e1000_read_reg(struct e1000_hw *hw, u32 reg);
+u32 e1000_mdic_wait(struct e1000_hw *hw);
 
 #define E1000_WRITE_REG_ARRAY(hw, reg, idx, val) \
 	E1000_WRITE_REG((hw), (reg) + ((idx) << 2), (val))
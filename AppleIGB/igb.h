@@ -28,7 +28,6 @@
 #define _IGB_H_
 
 #ifdef	__APPLE__
-#define	IGB_NO_LRO
 #define	HAVE_VLAN_RX_REGISTER
 #define HAVE_NETDEV_VLAN_FEATURES
 #include <AvailabilityMacros.h>
@@ -116,10 +115,32 @@ struct igb_adapter;
 #define IGB_DEFAULT_TX_WORK		 512
 #define IGB_MIN_TXD                       80
 #define IGB_MAX_TXD                     4096
+#ifdef __APPLE__
+#define IGB_TX_BATCH_DEFAULT              32 /* descriptors per Tx doorbell */
+#define IGB_TX_FLUSH_US                   50 /* longest doorbell deferral */
+#endif
 
 #define IGB_DEFAULT_RXD                  1024
 #define IGB_MIN_RXD                       80
 #define IGB_MAX_RXD                     4096
+#ifdef __APPLE__
+#define IGB_POLL_WEIGHT                   64 /* packets per igb_poll pass */
+#define IGB_POLL_BUDGET                  512 /* packets before a vector yields */
+#define IGB_POLL_US                      200 /* time before a vector yields */
+#define IGB_BUSY_POLL_MAX_US     IGB_POLL_US /* longest busy poll window */
+#define IGB_BUSY_POLL_BUCKETS             12 /* latency histogram, 1 us to 1 ms */
+#define IGB_STATS_RARE_TICKS              10 /* hot stats passes per full pass */
+#define IGB_MDIC_FIRST_US                 26 /* one MDIO frame at 2.5 MHz */
+#define IGB_MDIC_STEP_US                   8 /* MDIC polls after the first */
+#define IGB_MDIC_FAST_US                 100 /* then 50 us polls as before */
+#define IGB_MDIC_BUCKETS                  12 /* wait histogram, 32 us to 32 ms */
+#define IGB_CACHE_BYTES                   64 /* line size of the ring layout */
+/* kcompat keeps the kernel's cache line macros empty, only the rings and
+ * the q_vectors that hold them, which kzalloc_aligned, are aligned */
+#define ____igb_cacheline_aligned	__attribute__((__aligned__(IGB_CACHE_BYTES)))
+#else
+#define ____igb_cacheline_aligned	____cacheline_internodealigned_in_smp
+#endif
 
 #define IGB_MIN_ITR_USECS                 10 /* 100k irq/sec */
 #define IGB_MAX_ITR_USECS               8191 /* 120  irq/sec */
@@ -242,6 +263,45 @@ struct igb_lro_stats {
  * This structure relies on the check above that verifies that the header
  * is IPv4 and does not contain any options.
  */
+#ifdef __APPLE__
+/* mbufs start at the Ethernet header, so iph is only 2 byte aligned */
+struct igb_lrohdr {
+	struct iphdr iph;
+	struct tcphdr th;
+	__be32 ts[0];
+} __attribute__((__packed__));
+
+/*
+ * igb_lro_flow - a TCP/IPv4 flow being coalesced on one queue vector
+ * @head: first frame, its headers are rewritten to cover the chain on flush
+ * @tail: last mbuf of the chain, so appending does not walk it
+ *
+ * The remaining fields are what struct igb_cb keeps per skb on Linux.
+ */
+struct igb_lro_flow {
+	mbuf_t head;
+	mbuf_t tail;
+	__be32 saddr;
+	__be32 daddr;
+	__be32 ports;			/* source and destination port */
+	__be32 ack_seq;
+	__be32 tsecr;			/* timestamp echo response */
+	u32 tsval;			/* timestamp value in host order */
+	u32 next_seq;			/* next expected sequence number */
+	__be16 window;
+	u16 vid;			/* VLAN tag */
+	u16 free;			/* 65521 minus total size */
+	u16 mss;			/* size of data portion of packet */
+	u16 append_cnt;			/* number of frames appended */
+};
+
+/* flows[] is kept oldest first and is empty outside igb_clean_rx_irq */
+struct igb_lro_list {
+	struct igb_lro_flow flows[IGB_LRO_MAX];
+	u16 count;
+	struct igb_lro_stats stats;
+};
+#else
 struct igb_lrohdr {
 	struct iphdr iph;
 	struct tcphdr th;
@@ -252,6 +312,7 @@ struct igb_lro_list {
 	struct sk_buff_head active;
 	struct igb_lro_stats stats;
 };
+#endif /* __APPLE__ */
 
 #endif /* IGB_NO_LRO */
 struct igb_cb {
@@ -306,6 +367,11 @@ enum igb_tx_flags {
 #else
 #define DESC_NEEDED	(MAX_SKB_FRAGS + 4)
 #endif
+#ifdef __APPLE__
+/* a ring stops with fewer than DESC_NEEDED free descriptors and is woken
+ * once this many are free again, so stop and wake do not ping-pong */
+#define IGB_TX_WAKE_THRESH(R)	max_t(u16, DESC_NEEDED * 2, (R)->count / 4)
+#endif
 
 /* wrapper around a pointer to a socket buffer,
  * so a DMA handle can be stored along with the buffer */
@@ -322,13 +388,43 @@ struct igb_tx_buffer {
 	u32 tx_flags;
 };
 
+#ifdef	__APPLE__
+/*
+ * Receive buffers are IGB_RX_BUFSZ slots carved out of larger wired
+ * chunks.  Free slots sit on a lock-free LIFO so that the mbuf free
+ * routine of loaned buffers can return them from any thread.
+ */
+#define IGB_RX_POOL_CHUNK	(64 * 1024)
+#define IGB_RX_POOL_SLOTS	(IGB_RX_POOL_CHUNK / IGB_RX_BUFSZ)
+#define IGB_RX_POOL_GROWTH	4	/* max pool size in multiples of the ring */
+#define IGB_RX_POOL_NONE	0xffffffff
+
+struct igb_rx_pool;
+
+struct igb_rx_slot {
+	struct igb_rx_pool *pool;	/* owner, for the mbuf free routine */
+	u8 *va;
+	dma_addr_t dma;
+	u32 next;			/* freelist link */
+};
+
+struct igb_rx_pool {
+	volatile UInt64 free_head;	/* generation << 32 | slot index */
+	volatile SInt32 refcnt;		/* ring + one per loaned slot */
+	u32 nchunks;
+	u32 max_chunks;
+	IOBufferMemoryDescriptor **chunks;
+	struct igb_rx_slot *slots;
+};
+#endif
+
 struct igb_rx_buffer {
 	dma_addr_t dma;
 #ifdef CONFIG_IGB_DISABLE_PACKET_SPLIT
 	struct sk_buff *skb;
 #else
 #ifdef	__APPLE__
-	IOBufferMemoryDescriptor* page;
+	struct igb_rx_slot *page;
 #else
 	struct page *page;
 #endif
@@ -342,12 +438,29 @@ struct igb_tx_queue_stats {
 	u64 restart_queue;
 };
 
+#ifdef __APPLE__
+/* written by the transmit path only, kept apart from igb_tx_queue_stats */
+struct igb_tx_submit_stats {
+	u64 doorbells;		/* tail register writes */
+	u64 doorbell_pkts;	/* packets covered by those writes */
+	u64 stops;		/* high watermark hits, restart_queue counts wakes */
+	u64 tx_busy;		/* packets handed back to the output queue */
+};
+#endif
+
 struct igb_rx_queue_stats {
 	u64 packets;
 	u64 bytes;
 	u64 drops;
 	u64 csum_err;
 	u64 alloc_failed;
+#ifdef __APPLE__
+	u64 loaned;		/* frames handed up in their DMA page */
+	u64 copied_bytes;	/* bytes copied out of the ring */
+	u64 pool_hits;		/* buffers taken from the free list */
+	u64 pool_misses;	/* free list empty, pool had to grow */
+	u64 hdr_split;		/* frames whose headers were split off */
+#endif
 };
 
 struct igb_rx_packet_stats {
@@ -376,6 +489,10 @@ struct igb_ring {
 #ifdef __APPLE__
 	AppleIGB* netdev;
 	IOBufferMemoryDescriptor* pool;
+	struct igb_rx_pool *rx_pool;
+	IOBufferMemoryDescriptor* hdr_pool;	/* header split buffers */
+	u8 *hdr_va;			/* NULL unless header split is on */
+	dma_addr_t hdr_dma;
 #else
 	struct net_device *netdev;      /* back pointer to net_device */
 	struct device *dev;             /* device for dma mapping */
@@ -397,6 +514,47 @@ struct igb_ring {
 	u8 queue_index;                 /* logical index of the ring*/
 	u8 reg_idx;                     /* physical index of the ring */
 
+#ifdef __APPLE__
+	/*
+	 * Everything past this point is written often.  The consumer
+	 * (igb_clean_tx_irq/igb_clean_rx_irq on the queue work loop) and
+	 * the Tx producer (outputPacket on the controller work loop) each
+	 * get their own cache lines so neither keeps stealing the other's.
+	 */
+	u16 next_to_clean ____igb_cacheline_aligned;
+	u16 next_to_alloc;
+
+	union {
+		/* TX, clean path */
+		struct {
+			struct u64_stats_sync tx_syncp;	/* igb_clean_tx_irq */
+			struct igb_tx_queue_stats tx_stats;
+		};
+		/* RX */
+		struct {
+			struct u64_stats_sync rx_syncp;	/* igb_clean_rx_irq */
+			struct u64_stats_sync rx_syncp2;	/* igb_update_stats */
+			u64 rx_drops;		/* RQDPC total, under rx_syncp2 */
+			struct igb_rx_queue_stats rx_stats;
+			struct igb_rx_packet_stats pkt_stats;
+#ifdef CONFIG_IGB_DISABLE_PACKET_SPLIT
+			u16 rx_buffer_len;
+#else
+			struct sk_buff *skb;
+			struct sk_buff *skb_tail;	/* last mbuf of skb */
+			bool skb_failed;	/* a fragment of skb was lost */
+#endif
+		};
+	};
+
+	/* TX, transmit path; next_to_use is only moved by the Rx refill otherwise */
+	u16 next_to_use ____igb_cacheline_aligned;
+	u16 next_to_flush;		/* last value written to tail */
+	u16 tx_pending;			/* packets queued since then */
+	volatile u32 tx_stopped;	/* set by the producer, cleared on wake */
+	struct u64_stats_sync tx_syncp2;	/* transmit path */
+	struct igb_tx_submit_stats tx_submit_stats;
+#else
 	/* everything past this point are written often */
 	u16 next_to_clean;
 	u16 next_to_use;
@@ -418,15 +576,32 @@ struct igb_ring {
 #endif
 		};
 	};
+#endif
 #ifdef CONFIG_IGB_VMDQ_NETDEV
 	struct net_device *vmdq_netdev;
 	int vqueue_index;		/* queue index for virtual netdev */
 #endif
-} ____cacheline_internodealigned_in_smp;
+} ____igb_cacheline_aligned;
+
+#ifdef __APPLE__
+/* interrupt moderation policy, run each time a vector is re-armed */
+struct igb_itr_ops {
+	const char *name;
+	void (*update)(struct igb_q_vector *q_vector);
+};
+
+#define IGB_ITR_TIERED			0 /* igb_set_itr/igb_update_ring_itr */
+#define IGB_ITR_TARGET			1 /* aim for itr_target packets per irq */
+#endif
 
 struct igb_q_vector {
 	struct igb_adapter *adapter;	/* backlink */
+#ifdef __APPLE__
+	/* hot: touched on every interrupt and re-arm, by one work loop */
+	const struct igb_itr_ops *itr_ops;
+#else
 	int cpu;			/* CPU for DCA */
+#endif
 	u32 eims_value;			/* EIMS mask value */
 
 	u16 itr_val;
@@ -435,6 +610,16 @@ struct igb_q_vector {
 
 	struct igb_ring_container rx, tx;
 
+#ifdef __APPLE__
+	/* frames cleaned this poll, see AppleIGB::receive */
+	mbuf_t rx_batch;
+	mbuf_t rx_batch_tail;
+	u32 rx_batch_len;
+
+	/* cold: setup, teardown and DCA only */
+	int cpu;			/* CPU for DCA */
+	size_t alloc_size;
+#endif
 	struct napi_struct napi;
 #ifndef IGB_NO_LRO
 	struct igb_lro_list lrolist;   /* LRO list for queue vector*/
@@ -443,12 +628,9 @@ struct igb_q_vector {
 	char name[IFNAMSIZ + 9];
 #ifndef HAVE_NETDEV_NAPI_LIST
 	struct net_device poll_dev;
-#endif
-#ifdef	__APPLE__
-	size_t alloc_size;
 #endif
 	/* for dynamic allocation of rings associated with this q_vector */
-	struct igb_ring ring[0] ____cacheline_internodealigned_in_smp;
+	struct igb_ring ring[0] ____igb_cacheline_aligned;
 };
 
 enum e1000_ring_flags_t {
@@ -478,6 +660,11 @@ struct igb_mac_addr {
 	(&(((union e1000_adv_tx_desc *)((R)->desc))[i]))
 #define IGB_TX_CTXTDESC(R, i)	    \
 	(&(((struct e1000_adv_tx_context_desc *)((R)->desc))[i]))
+#ifdef __APPLE__
+/* header buffer of Rx descriptor i, one IGB_RX_HDR_LEN slice each */
+#define IGB_RX_HDR(R, i)	((R)->hdr_va + (i) * IGB_RX_HDR_LEN)
+#define IGB_RX_HDR_DMA(R, i)	((R)->hdr_dma + (i) * IGB_RX_HDR_LEN)
+#endif
 
 #ifdef CONFIG_IGB_VMDQ_NETDEV
 #define netdev_ring(ring) \
@@ -545,6 +732,29 @@ struct hwmon_buff {
 #define IGB_RETA_SIZE	128
 #endif /* ETHTOOL_GRXFHINDIR */
 
+#ifdef __APPLE__
+/* bring-up phases published under "BootPhases" */
+enum igb_boot_phase {
+	IGB_PHASE_PROBE,	/* all of igb_probe */
+	IGB_PHASE_INIT_FUNCS,	/* e1000_setup_init_funcs */
+	IGB_PHASE_SW_INIT,	/* igb_sw_init, including the above */
+	IGB_PHASE_NVM,		/* checksum validation and MAC address read */
+	IGB_PHASE_RESET,	/* every igb_reset */
+	IGB_PHASE_OPEN,		/* all of igb_open */
+	IGB_PHASE_RINGS,	/* descriptor ring allocation in igb_open */
+	IGB_PHASE_PHY_UP,	/* every igb_power_up_link */
+	IGB_PHASE_CONFIGURE,	/* igb_configure in igb_open */
+	IGB_PHASE_LINK,		/* enable() until the first link up */
+	IGB_PHASE_COUNT
+};
+
+struct igb_boot_timer {
+	u64 start;	/* mach_absolute_time, 0 when not running */
+	u64 ns;		/* total over all runs */
+	u32 count;
+};
+#endif /* __APPLE__ */
+
 /* board specific private data structure */
 struct igb_adapter {
 #ifdef HAVE_VLAN_RX_REGISTER
@@ -564,6 +774,9 @@ struct igb_adapter {
 
 	unsigned int num_q_vectors;
 	struct msix_entry *msix_entries;
+#ifdef __APPLE__
+	unsigned int num_msix_entries;
+#endif
 
 
 	/* TX */
@@ -720,6 +933,28 @@ struct igb_adapter {
 	u32 rss_indir_tbl_init;
 	u8 rss_indir_tbl[IGB_RETA_SIZE];
 #endif
+#ifdef __APPLE__
+	u32 stats_ticks;	/* igb_update_stats_periodic passes */
+	u64 stats_reads;	/* statistics register reads */
+	u32 stats_passes[2];	/* hot and full igb_update_stats passes */
+	u64 stats_ns[2];	/* time spent in them */
+	u32 itr_ctl;		/* IGB_ITR_TIERED or IGB_ITR_TARGET */
+	u32 itr_target;		/* packets per interrupt for IGB_ITR_TARGET */
+	struct igb_boot_timer boot_phase[IGB_PHASE_COUNT];
+	/* NVM words [0, nvm_shadow_words), read once at probe */
+	u16 *nvm_shadow;
+	u16 nvm_shadow_words;
+	bool nvm_shadow_valid;
+	u32 nvm_shadow_hits;	/* reads served from the shadow */
+	u32 nvm_hw_words;	/* words read from the NVM itself */
+	/* the uncached ops, wrapped by igb_nvm_shadow_hook */
+	s32 (*nvm_read)(struct e1000_hw *, u16, u16, u16 *);
+	s32 (*nvm_write)(struct e1000_hw *, u16, u16, u16 *);
+	s32 (*nvm_update)(struct e1000_hw *);
+	/* MDIC waits by power of two microseconds, from 32 us */
+	u32 mdic_wait_hist[IGB_MDIC_BUCKETS];
+	u32 mdic_timeouts;
+#endif
 };
 
 #ifdef CONFIG_IGB_VMDQ_NETDEV
@@ -857,6 +1092,10 @@ extern void igb_update_stats(struct igb_adapter *);
 extern bool igb_has_link(struct igb_adapter *adapter);
 extern void igb_set_ethtool_ops(struct net_device *);
 extern void igb_check_options(struct igb_adapter *);
+#ifdef __APPLE__
+extern void igb_set_option(u32 bd, const char *name, int value);
+extern void igb_update_stats_periodic(struct igb_adapter *);
+#endif
 extern void igb_power_up_link(struct igb_adapter *);
 #ifdef HAVE_PTP_1588_CLOCK
 extern void igb_ptp_init(struct igb_adapter *adapter);
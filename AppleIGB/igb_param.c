@@ -4,6 +4,7 @@
 
 #ifdef    __APPLE__
 #include <sys/sysctl.h>
+#include <string.h>
 
 static int num_online_cpus()
 {
@@ -61,7 +62,7 @@ static int num_online_cpus()
 #endif
 #ifdef    __APPLE__
 #undef    IGB_PARAM
-#define IGB_PARAM(X, desc) static const int X[IGB_MAX_NIC+1] = IGB_PARAM_INIT;
+#define IGB_PARAM(X, desc) static int X[IGB_MAX_NIC+1] = IGB_PARAM_INIT;
 #endif
 
 /* Interrupt Throttle Rate (interrupts/sec)
@@ -129,12 +130,17 @@ IGB_PARAM(LLISize,
  *
  * Valid Range: 0 - 8
  *
- * Default Value:  1
+ * Default Value:  1, 0 on macOS
  */
 IGB_PARAM(RSS,
     "Number of Receive-Side Scaling Descriptor Queues (0-8), default 1, 0=number of cpus");
 
+#ifdef __APPLE__
+/* each queue has its own work loop, so spread over the CPUs */
+#define DEFAULT_RSS       0
+#else
 #define DEFAULT_RSS       1
+#endif
 #define MAX_RSS           8
 #define MIN_RSS           0
 
@@ -227,7 +233,7 @@ IGB_PARAM(EEE,
 IGB_PARAM(DMAC,
 	"Disable or set latency for DMA Coalescing ((0=off, 1000-10000(msec), 250, 500 (usec))");
 
-#ifndef IGB_NO_LRO
+#if !defined(IGB_NO_LRO) && !defined(__APPLE__)
 /* Enable/disable Large Receive Offload
  *
  * Valid Values: 0(off), 1(on)
@@ -237,6 +243,30 @@ IGB_PARAM(DMAC,
 IGB_PARAM(LRO, "Large Receive Offload (0,1), default 0=off");
 
 #endif
+#ifdef __APPLE__
+/* ItrController (Interrupt moderation algorithm)
+ *
+ * Valid Range: 0 - 1
+ *
+ * Default Value: 0 (tiered)
+ */
+IGB_PARAM(ItrController,
+	"Interrupt moderation (0=tiered, 1=target packets per interrupt), default 0");
+
+/* ItrTargetPackets (Packets per interrupt for ItrController=1)
+ *
+ * Valid Range: 1 - 256
+ *
+ * Default Value: 24
+ */
+IGB_PARAM(ItrTargetPackets,
+	"Packets per interrupt the target controller aims for (1-256), default 24");
+
+#define DEFAULT_ITR_TARGET            24
+#define MAX_ITR_TARGET               256
+#define MIN_ITR_TARGET                 1
+
+#endif /* __APPLE__ */
 struct igb_opt_list {
 	int i;
 	char *str;
@@ -823,7 +853,7 @@ void igb_check_options(struct igb_adapter *adapter)
 #endif
 		}
 	}
-#ifndef IGB_NO_LRO
+#if !defined(IGB_NO_LRO) && !defined(__APPLE__)
 	{ /* LRO - Enable Large Receive Offload */
 		struct igb_option opt = {
 			.type = enable_option,
@@ -870,5 +900,75 @@ void igb_check_options(struct igb_adapter *adapter)
 		}
 #endif
 	}
+#ifdef __APPLE__
+	{ /* Interrupt moderation controller */
+		struct igb_option opt = {
+			.type = range_option,
+			.name = "Interrupt moderation controller",
+			.err  = "defaulting to 0 (tiered)",
+			.def  = IGB_ITR_TIERED,
+			.arg  = { .r = { .min = IGB_ITR_TIERED,
+					 .max = IGB_ITR_TARGET } }
+		};
+		unsigned int itr_ctl = ItrController[bd];
+
+		igb_validate_option(&itr_ctl, &opt, adapter);
+		adapter->itr_ctl = itr_ctl;
+	}
+	{ /* Target packets per interrupt */
+		struct igb_option opt = {
+			.type = range_option,
+			.name = "Target packets per interrupt",
+			.err  = "using default of "
+				__MODULE_STRING(DEFAULT_ITR_TARGET),
+			.def  = DEFAULT_ITR_TARGET,
+			.arg  = { .r = { .min = MIN_ITR_TARGET,
+					 .max = MAX_ITR_TARGET } }
+		};
+		unsigned int itr_target = ItrTargetPackets[bd];
+
+		igb_validate_option(&itr_target, &opt, adapter);
+		adapter->itr_target = itr_target;
+	}
+#endif /* __APPLE__ */
 }
 
+#ifdef __APPLE__
+/**
+ * igb_set_option - set a module parameter for one board
+ * @bd: board number, as assigned in igb_probe
+ * @name: parameter name, as on the Linux module command line
+ * @value: parameter value, range checked later by igb_check_options
+ *
+ * macOS has no module parameters, so AppleIGB reads them from the IOKit
+ * personality and stores them here before igb_sw_init runs.  Unknown
+ * names are ignored.
+ **/
+void igb_set_option(u32 bd, const char *name, int value)
+{
+	static const struct {
+		const char *name;
+		int *param;
+	} params[] = {
+		{ "InterruptThrottleRate", InterruptThrottleRate },
+		{ "IntMode", IntMode },
+		{ "RSS", RSS },
+		{ "LLIPort", LLIPort },
+		{ "LLIPush", LLIPush },
+		{ "LLISize", LLISize },
+		{ "ItrController", ItrController },
+		{ "ItrTargetPackets", ItrTargetPackets },
+	};
+	unsigned int i;
+
+	if (bd > IGB_MAX_NIC)
+		bd = IGB_MAX_NIC;
+
+	for (i = 0; i < sizeof(params) / sizeof(params[0]); i++) {
+		if (!strcmp(params[i].name, name)) {
+			params[i].param[bd] = value;
+			return;
+		}
+	}
+}
+#endif /* __APPLE__ */
@@ -8,6 +8,7 @@
 #define _KCOMPAT_H_
 
 #include <os/log.h>
+#include <libkern/OSAtomic.h>
 
 typedef __int64_t s64;
 typedef __int32_t s32;
@@ -271,10 +272,17 @@ static inline unsigned int _kc_ether_crc_le(int length, unsigned char *data)
 #define	EBUSY	16
 #define EINVAL  22  /* Invalid argument */
 /*****************************************************************************/
+#ifdef IGB_DEBUG_SLEEP_SITES
+/* millisecond waits are timed per calling function, see "SleepSites" */
+void igb_delay_site(const char *site, unsigned int ms, int busy);
+#define msleep(x)	igb_delay_site(__func__, (x), 0)
+#define mdelay(x)	igb_delay_site(__func__, (x), 1)
+#else
 #define msleep(x)	IOSleep(x)
+#define mdelay(x)	for(int i = 0; i < x; i++ )udelay(1000)
+#endif
 #define udelay(x)	IODelay(x)
 
-#define mdelay(x)	for(int i = 0; i < x; i++ )udelay(1000)
 #define DIV_ROUND_UP(n,d) (((n) + (d) - 1) / (d))
 #define usleep_range(min, max)	msleep(DIV_ROUND_UP(min, 1000))	
 
@@ -443,6 +451,57 @@ static inline int test_and_set_bit(int nr, volatile unsigned long * addr) {
 	return rc;
 }
 
+/* release: earlier stores land before later ones; acquire: earlier
+ * loads complete before later ones */
+#define	smp_wmb()	__atomic_thread_fence(__ATOMIC_RELEASE)
+#define	smp_rmb()	OSMemoryBarrier()
+#if defined(__x86_64__) || defined(__i386__)
+#define	cpu_relax()	__asm__ __volatile__("pause" : : : "memory")
+#else
+#define	cpu_relax()	__asm__ __volatile__("yield" : : : "memory")
+#endif
+
+/* 64 bit counters with one writer at a time, read from other threads
+ * without a lock: seq is odd while an update is in progress.  Each
+ * u64_stats_sync covers its own set of fields, a reader must not look
+ * at fields another one guards. */
+struct u64_stats_sync {
+	volatile u32 seq;
+};
+
+static inline void u64_stats_init(struct u64_stats_sync *syncp) {
+	syncp->seq = 0;
+}
+
+/* the writer runs once per packet or clean pass, so only a release
+ * fence, which costs nothing on x86 */
+static inline void u64_stats_update_begin(struct u64_stats_sync *syncp) {
+	syncp->seq++;
+	smp_wmb();
+}
+
+static inline void u64_stats_update_end(struct u64_stats_sync *syncp) {
+	smp_wmb();
+	syncp->seq++;
+}
+
+/* a writer only holds seq odd for a few stores, unless it is preempted,
+ * and then the reader waits for it */
+static inline unsigned int u64_stats_fetch_begin(const struct u64_stats_sync *syncp) {
+	unsigned int seq;
+
+	while ((seq = syncp->seq) & 1)
+		cpu_relax();
+	smp_rmb();
+	return seq;
+}
+
+static inline int u64_stats_fetch_retry(const struct u64_stats_sync *syncp,
+					 unsigned int start) {
+	smp_rmb();
+	return syncp->seq != start;
+}
+
 
 static inline int is_valid_ether_addr(const u8 *addr)
 {